@@ -0,0 +1,95 @@
+#include "AllocTracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<unsigned long long> g_allocations{ 0 };
+    std::atomic<unsigned long long> g_bytes{ 0 };
+
+    // Plain integers, so they need no constructor and are usable before
+    // anything else in the thread has run.
+    thread_local unsigned long long t_allocations = 0;
+    thread_local unsigned long long t_bytes = 0;
+
+    void* allocate(std::size_t size) noexcept
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        t_allocations++;
+        t_bytes += size;
+        return std::malloc(size ? size : 1);
+    }
+}
+
+namespace AllocTracker
+{
+    Counts total()
+    {
+        Counts counts;
+        counts.allocations = g_allocations.load(std::memory_order_relaxed);
+        counts.bytes = g_bytes.load(std::memory_order_relaxed);
+        return counts;
+    }
+
+    Counts thisThread()
+    {
+        Counts counts;
+        counts.allocations = t_allocations;
+        counts.bytes = t_bytes;
+        return counts;
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* p = allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
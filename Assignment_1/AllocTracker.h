@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+// Counts heap allocations made through the global operator new, which
+// AllocTracker.cpp replaces. Linking it into a program is all it takes; the
+// Profiler reads the counters to report allocations per frame and per zone.
+//
+// Only memory requested with new is seen. malloc calls, and allocations made
+// inside prebuilt libraries with their own runtime (the SFML DLLs on
+// Windows), are not counted.
+namespace AllocTracker
+{
+    struct Counts
+    {
+        unsigned long long allocations = 0;
+        unsigned long long bytes = 0;
+    };
+
+    // Allocations made by every thread since startup.
+    Counts total();
+    // Allocations made by the calling thread since it started.
+    Counts thisThread();
+}
@@ -0,0 +1,958 @@
+﻿// Headless benchmark for the fire, water and light scenes. Nothing here opens
+// a window or creates an ImGui context, so it runs on machines without a
+// display. Results are printed to stdout as one JSON document.
+//
+// The fire, water and light scenes must not allocate once warmed up: a heap
+// allocation during their measured steps fails the run.
+#include "AllocTracker.h"
+#include "FastMath.h"
+#include "ParticleSys.h"
+#include "WaterSim.h"
+#include "LightScene.h"
+#include "Random.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        std::string scene = "all";
+        int steps = 600;
+        int warmup = 120;
+        uint64_t seed = 1;
+        unsigned width = 1280;
+        unsigned height = 720;
+        int particles = 100000;
+        int emitters = 1;
+        ParticleSys::ParticleShape shape = ParticleSys::ParticleShape::Torch;
+        // Runs the fire scene once for every shape.
+        bool allShapes = false;
+        unsigned threads = WorkerPool::hardwareThreads();
+        int balls = 20;
+        int columns = WaterParams().resolution;
+        int collideBalls = 20000;
+        int renderBalls = 10000;
+    };
+
+    // Timing and allocations of the measured steps of one scene.
+    struct Measure
+    {
+        Clock::time_point start;
+        AllocTracker::Counts allocations;
+
+        Measure() : start(Clock::now()), allocations(AllocTracker::total()) {}
+
+        double elapsedNs() const
+        {
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+
+        unsigned long long allocated() const
+        {
+            return AllocTracker::total().allocations - allocations.allocations;
+        }
+
+        unsigned long long allocatedBytes() const
+        {
+            return AllocTracker::total().bytes - allocations.bytes;
+        }
+    };
+
+    const float kStep = 1.0f / 60.0f;
+
+    bool first = true;
+    bool failed = false;
+
+    void beginResult(const char* scene)
+    {
+        std::printf("%s\n    { \"scene\": \"%s\"", first ? "" : ",", scene);
+        first = false;
+    }
+
+    void endResult()
+    {
+        std::printf(" }");
+    }
+
+    // Reports the allocations of a steady-state scene and fails the run if
+    // there were any.
+    void printAllocations(const Measure& measure, int steps)
+    {
+        const unsigned long long allocations = measure.allocated();
+        std::printf(", \"allocs_per_step\": %.3f, \"bytes_per_step\": %.1f",
+            static_cast<double>(allocations) / steps, static_cast<double>(measure.allocatedBytes()) / steps);
+        failed = failed || allocations != 0;
+    }
+
+    // Shape name as used on the command line and in the results.
+    std::string shapeId(ParticleSys::ParticleShape shape)
+    {
+        std::string id = ParticleSys::shapeName(shape);
+        for (char& c : id)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return id;
+    }
+
+    void runFire(const Options& options, ParticleSys::ParticleShape shape)
+    {
+        ParticleSys particles;
+
+        ParticleSys::Params params = particles.getParams();
+        params.threads = options.threads;
+        params.emitter.shape = shape;
+        params.emitter.count = static_cast<float>(options.particles / options.emitters);
+        params.emitter.emitterLife = 0.0f;
+        particles.setParams(params);
+
+        // Emitters are spread evenly over the middle row of the scene.
+        const sf::Vector2f size(static_cast<float>(options.width), static_cast<float>(options.height));
+        particles.init(sf::Vector2u(options.width / 2, options.height / 2));
+        for (int e = 1; e < options.emitters; e++)
+            particles.addEmitter(sf::Vector2f(size.x * e / options.emitters, size.y / 2));
+        particles.setSeed(options.seed);
+
+        for (int i = 0; i < options.warmup; i++)
+        {
+            particles.update(kStep);
+            particles.buildVertices(1.0f);
+        }
+
+        double aliveSum = 0;
+        Measure measure;
+        for (int i = 0; i < options.steps; i++)
+        {
+            particles.update(kStep);
+            particles.buildVertices(1.0f);
+            aliveSum += static_cast<double>(particles.getAliveCount());
+        }
+        const double ns = measure.elapsedNs();
+        const double nsPerStep = ns / options.steps;
+        const double alive = aliveSum / options.steps;
+
+        beginResult("fire");
+        std::printf(", \"shape\": \"%s\", \"emitters\": %d, \"threads\": %u, \"steps\": %d",
+            shapeId(shape).c_str(), static_cast<int>(particles.getEmitterCount()), options.threads, options.steps);
+        std::printf(", \"alive\": %.0f, \"ns_per_step\": %.1f, \"ns_per_particle\": %.3f",
+            alive, nsPerStep, alive > 0 ? nsPerStep / alive : 0.0);
+        printAllocations(measure, options.steps);
+        endResult();
+    }
+
+    // The particle system as it was before the structure-of-arrays rewrite,
+    // kept as the baseline of the layout scene: an array of Particle structs
+    // next to four full vertices per particle, all rewritten every update,
+    // with the shape checked per particle. Only the UI is left out.
+    class AosParticles
+    {
+        struct Particle
+        {
+            sf::Vector2f velocity;
+            int lifetime = 0;
+
+            float angle = 0.f;
+            float radius = 0.f;
+            float angularSpeed = 0.f;
+        };
+
+        std::vector<Particle> m_particles;
+        std::vector<sf::Vertex> m_vertices;
+        sf::Vector2u m_position;
+        float m_size = 8;
+        float m_time = 60;
+        ParticleSys::ParticleShape m_shape;
+        sf::Color baseColor = sf::Color(255, 100, 30, 255);
+
+        static float unit()
+        {
+            return static_cast<float>(std::rand()) / RAND_MAX;
+        }
+
+        void setQuad(size_t index, sf::Vector2f topLeft)
+        {
+            m_vertices[4 * index + 0].position = topLeft;
+            m_vertices[4 * index + 1].position = topLeft + sf::Vector2f(m_size, 0);
+            m_vertices[4 * index + 2].position = topLeft + sf::Vector2f(m_size, m_size);
+            m_vertices[4 * index + 3].position = topLeft + sf::Vector2f(0, m_size);
+        }
+
+        void resetParticle(size_t index)
+        {
+            typedef ParticleSys::ParticleShape Shape;
+            if (m_shape == Shape::Rain)
+                setQuad(index, sf::Vector2f(static_cast<float>(std::rand() % m_position.x) - m_size / 2, -m_size / 2));
+            else
+                setQuad(index, sf::Vector2f(static_cast<float>(m_position.x), static_cast<float>(m_position.y)));
+
+            for (int i = 0; i < 4; ++i)
+                m_vertices[4 * index + i].color = baseColor;
+
+            Particle& p = m_particles[index];
+            switch (m_shape)
+            {
+            case Shape::Torch:
+                p.velocity = sf::Vector2f((unit() - 0.5f) * 1.0f, -unit() * 2.0f - 1.0f);
+                break;
+            case Shape::Firework:
+            {
+                float theta = unit() * 2 * 3.14159f;
+                float radius = unit() * 5;
+                p.velocity = sf::Vector2f(radius * std::cos(theta), radius * std::sin(theta));
+                break;
+            }
+            case Shape::Fountain:
+                p.velocity = sf::Vector2f((unit() - 0.5f) * 0.5f, -unit() * 3.0f);
+                break;
+            case Shape::Spiral:
+                p.angle = unit() * 2 * 3.14159f;
+                p.radius = 0.0f;
+                p.angularSpeed = 0.1f + unit() * 0.2f;
+                p.velocity = sf::Vector2f(0, 0);
+                break;
+            case Shape::Explosion:
+            {
+                float theta = unit() * 2 * 3.14159f;
+                float power = 2.5f + unit() * 2.0f;
+                p.velocity = sf::Vector2f(power * std::cos(theta), power * std::sin(theta));
+                break;
+            }
+            default:
+                p.velocity = sf::Vector2f((unit() - 0.5f) * 0.2f, 1.0f + unit() * 1.0f);
+                break;
+            }
+            p.lifetime = 30 + std::rand() % static_cast<int>(m_time);
+        }
+
+    public:
+        AosParticles(size_t count, sf::Vector2u position, ParticleSys::ParticleShape shape)
+            : m_particles(count), m_vertices(count * 4), m_position(position), m_shape(shape)
+        {
+        }
+
+        void update()
+        {
+            typedef ParticleSys::ParticleShape Shape;
+            for (size_t p = 0; p < m_particles.size(); p++)
+            {
+                Particle& particle = m_particles[p];
+                if (particle.lifetime <= 0)
+                {
+                    resetParticle(p);
+                    continue;
+                }
+
+                float ratio = std::min(static_cast<float>(particle.lifetime) / 90.0f, 1.0f);
+                sf::Color c;
+                c.r = baseColor.r;
+                c.g = static_cast<sf::Uint8>(baseColor.g * ratio);
+                c.b = static_cast<sf::Uint8>(baseColor.b * ratio);
+                c.a = static_cast<sf::Uint8>(baseColor.a * ratio);
+
+                if (m_shape == Shape::Spiral)
+                {
+                    particle.angle += particle.angularSpeed;
+                    particle.radius += 0.5f;
+                    float x = m_position.x / 2 + std::cos(particle.angle) * particle.radius;
+                    float y = m_position.y / 2 + std::sin(particle.angle) * particle.radius;
+                    setQuad(p, sf::Vector2f(x - m_size / 2, y - m_size / 2));
+                }
+                else
+                {
+                    for (int i = 0; i < 4; ++i)
+                        m_vertices[4 * p + i].position += particle.velocity;
+                }
+
+                for (int i = 0; i < 4; ++i)
+                    m_vertices[4 * p + i].color = c;
+
+                if (m_shape == Shape::Fountain || m_shape == Shape::Rain)
+                    particle.velocity.y += 0.05f;
+
+                particle.lifetime--;
+            }
+        }
+    };
+
+    // Particle update and vertex building per particle at 1k to 1M particles,
+    // for the old array-of-structs layout above and for ParticleSys, both on
+    // one thread. Every old particle is live; ParticleSys is divided by its
+    // average live count.
+    void runLayout(const Options& options)
+    {
+        const int counts[] = { 1000, 10000, 100000, 1000000 };
+        for (int count : counts)
+        {
+            std::srand(static_cast<unsigned>(options.seed));
+            AosParticles aos(static_cast<size_t>(count), sf::Vector2u(options.width / 2, options.height / 2), options.shape);
+            for (int i = 0; i < options.warmup; i++)
+                aos.update();
+            Measure aosMeasure;
+            for (int i = 0; i < options.steps; i++)
+                aos.update();
+            const double aosNs = aosMeasure.elapsedNs() / options.steps / count;
+
+            ParticleSys particles;
+            ParticleSys::Params params = particles.getParams();
+            params.threads = 1;
+            params.emitter.shape = options.shape;
+            params.emitter.count = static_cast<float>(count);
+            params.emitter.emitterLife = 0.0f;
+            particles.setParams(params);
+            particles.init(sf::Vector2u(options.width / 2, options.height / 2));
+            particles.setSeed(options.seed);
+            for (int i = 0; i < options.warmup; i++)
+            {
+                particles.update(kStep);
+                particles.buildVertices(1.0f);
+            }
+            double aliveSum = 0;
+            Measure soaMeasure;
+            for (int i = 0; i < options.steps; i++)
+            {
+                particles.update(kStep);
+                particles.buildVertices(1.0f);
+                aliveSum += static_cast<double>(particles.getAliveCount());
+            }
+            const double soaNs = aliveSum > 0 ? soaMeasure.elapsedNs() / aliveSum : 0.0;
+
+            beginResult("layout");
+            std::printf(", \"shape\": \"%s\", \"particles\": %d, \"steps\": %d, \"aos_ns_per_particle\": %.3f"
+                ", \"soa_ns_per_particle\": %.3f, \"speedup\": %.2f",
+                shapeId(options.shape).c_str(), count, options.steps, aosNs, soaNs, soaNs > 0 ? aosNs / soaNs : 0.0);
+            endResult();
+        }
+    }
+
+    void runWater(const Options& options)
+    {
+        WaterSim sim;
+        WaterParams params = sim.getParams();
+        params.resolution = options.columns;
+        params.threads = options.threads;
+        sim.setParams(params);
+        Random random(options.seed);
+
+        // Balls are dropped from random heights above the pool, which spans
+        // 0.5 m to 7.5 m horizontally.
+        for (int b = 0; b < options.balls; b++)
+            sim.addBall(random.nextFloat(0.9f, 7.1f), random.nextFloat(0.2f, 2.0f));
+
+        for (int i = 0; i < options.warmup; i++)
+        {
+            sim.update(kStep);
+            sim.getWater().buildMesh(1.0f);
+        }
+
+        Measure measure;
+        for (int i = 0; i < options.steps; i++)
+        {
+            sim.update(kStep);
+            sim.getWater().buildMesh(1.0f);
+        }
+        const double ns = measure.elapsedNs();
+
+        beginResult("water");
+        std::printf(", \"balls\": %d, \"columns\": %d, \"steps\": %d, \"ball_substeps\": %d, \"wave_substeps\": %d, \"ns_per_step\": %.1f",
+            static_cast<int>(sim.getBalls().size()), options.columns, options.steps,
+            sim.getBallSteps(), sim.getWaveSteps(), ns / options.steps);
+        printAllocations(measure, options.steps);
+        endResult();
+    }
+
+    void addRenderBalls(WaterSim& sim, const Options& options, unsigned threads)
+    {
+        WaterParams params;
+        params.radius = 0.02f;
+        params.threads = threads;
+        sim.setParams(params);
+        Random random(options.seed);
+        for (int b = 0; b < options.renderBalls; b++)
+            sim.addBall(random.nextFloat(0.9f, 7.1f), random.nextFloat(0.2f, 2.0f));
+    }
+
+    // Whether two simulations hold bit for bit the same balls and surface.
+    bool sameState(const WaterSim& a, const WaterSim& b)
+    {
+        const std::vector<Ball>& ballsA = a.getBalls();
+        const std::vector<Ball>& ballsB = b.getBalls();
+        if (ballsA.size() != ballsB.size() || a.getWater().surfaceHeights != b.getWater().surfaceHeights ||
+            a.getWater().velocities != b.getWater().velocities)
+            return false;
+
+        for (size_t i = 0; i < ballsA.size(); i++)
+        {
+            if (ballsA[i].position != ballsB[i].position || ballsA[i].velocity != ballsB[i].velocity)
+                return false;
+        }
+        return true;
+    }
+
+    // A frame of the water scene with many small balls: the update and the
+    // CPU side of drawing the balls, which all go into one vertex list and
+    // one draw call. The GPU time of that draw is not included. The same
+    // balls are also stepped on one thread, for the speedup of the parallel
+    // ball step and to check that it gives the same result, also when the
+    // thread count changes between steps.
+    void runBalls(const Options& options)
+    {
+        WaterSim serial;
+        addRenderBalls(serial, options, 1);
+        WaterSim sim;
+        addRenderBalls(sim, options, options.threads);
+
+        // Restarting the pool between steps must not change the result
+        // either, so the first steps cycle through other thread counts.
+        const unsigned threadCounts[] = { 1, 2, options.threads + 1, 3 };
+        for (unsigned threads : threadCounts)
+        {
+            WaterParams params = sim.getParams();
+            params.threads = threads;
+            sim.setParams(params);
+            serial.update(kStep);
+            sim.update(kStep);
+        }
+        WaterParams params = sim.getParams();
+        params.threads = options.threads;
+        sim.setParams(params);
+
+        BallMesh mesh;
+        for (int i = 0; i < options.warmup; i++)
+        {
+            serial.update(kStep);
+            sim.update(kStep);
+            mesh.build(sim.getBalls(), 1.0f, SCALE);
+        }
+
+        const Clock::time_point serialStart = Clock::now();
+        for (int i = 0; i < options.steps; i++)
+            serial.update(kStep);
+        const double serialNs = std::chrono::duration<double, std::nano>(Clock::now() - serialStart).count() / options.steps;
+
+        double updateNs = 0.0, renderNs = 0.0;
+        size_t vertices = 0;
+        Measure measure;
+        for (int i = 0; i < options.steps; i++)
+        {
+            const Clock::time_point start = Clock::now();
+            sim.update(kStep);
+            const Clock::time_point updated = Clock::now();
+            vertices = mesh.build(sim.getBalls(), 1.0f, SCALE).size();
+            updateNs += std::chrono::duration<double, std::nano>(updated - start).count();
+            renderNs += std::chrono::duration<double, std::nano>(Clock::now() - updated).count();
+        }
+        updateNs /= options.steps;
+        renderNs /= options.steps;
+
+        const bool matches = sameState(serial, sim);
+        failed = failed || !matches;
+
+        beginResult("balls");
+        std::printf(", \"balls\": %d, \"threads\": %u, \"steps\": %d, \"vertices\": %d, \"draw_calls\": 1"
+            ", \"update_ns\": %.1f, \"serial_update_ns\": %.1f, \"speedup\": %.2f, \"matches_serial\": %s"
+            ", \"render_ns\": %.1f, \"frame_ms\": %.3f",
+            static_cast<int>(sim.getBalls().size()), sim.getParams().threads, options.steps, static_cast<int>(vertices),
+            updateNs, serialNs, updateNs > 0 ? serialNs / updateNs : 0.0, matches ? "true" : "false",
+            renderNs, (updateNs + renderNs) * 1e-6);
+        printAllocations(measure, options.steps);
+        endResult();
+    }
+
+    void runLight(const Options& options)
+    {
+        LightScene scene;
+        Random random(options.seed);
+        const sf::Vector2f size(static_cast<float>(options.width), static_cast<float>(options.height));
+
+        std::vector<sf::Vector2f> path(static_cast<size_t>(options.steps));
+        for (sf::Vector2f& position : path)
+            position = sf::Vector2f(random.nextFloat(0.0f, size.x), random.nextFloat(0.0f, size.y));
+
+        for (int i = 0; i < options.warmup; i++)
+        {
+            scene.setPlayerPosition(path[i % path.size()]);
+            scene.castRays(size);
+            scene.sortIntersections();
+            scene.buildLightPolygon();
+        }
+
+        unsigned long long rays = 0;
+        Measure measure;
+        for (int i = 0; i < options.steps; i++)
+        {
+            scene.setPlayerPosition(path[i]);
+            rays += scene.castRays(size);
+            scene.sortIntersections();
+            scene.buildLightPolygon();
+        }
+        const double ns = measure.elapsedNs();
+
+        beginResult("light");
+        std::printf(", \"steps\": %d, \"rays_per_step\": %.1f, \"ns_per_step\": %.1f, \"rays_per_s\": %.0f",
+            options.steps, static_cast<double>(rays) / options.steps, ns / options.steps,
+            ns > 0 ? rays * 1e9 / ns : 0.0);
+        printAllocations(measure, options.steps);
+        endResult();
+    }
+
+    // Initial bump of the waves scene: a Gaussian in the middle of the pool,
+    // flat to float precision at the fixed ends.
+    double waveBump(double x, double length)
+    {
+        const double width = length / 20.0;
+        const double u = (x - 0.5 * length) / width;
+        return 10.0 * std::exp(-u * u);
+    }
+
+    // Exact height of the bump released at rest on a surface with fixed
+    // ends, after its halves have travelled the given distance: d'Alembert's
+    // solution with the bump continued oddly about both ends.
+    double exactWave(double x, double length, double travelled)
+    {
+        auto extended = [length](double s) {
+            s = std::fmod(s, 2.0 * length);
+            if (s < 0.0)
+                s += 2.0 * length;
+            return s <= length ? waveBump(s, length) : -waveBump(2.0 * length - s, length);
+        };
+        return 0.5 * (extended(x - travelled) + extended(x + travelled));
+    }
+
+    // Explicit against implicit waves, without damping or balls, on a pool
+    // released from the bump above. The explicit solver takes CFL substeps,
+    // the implicit one a single step per update. Both are timed and compared
+    // with the exact solution; the error is RMS over the columns relative to
+    // the bump height.
+    void runWaves(const Options& options)
+    {
+        const WaterParams params;
+        const float dt = kStep * params.timeScale;
+        const float length = 700.0f;
+
+        for (int s = 0; s < 2; s++)
+        {
+            const WaveSolver solver = s == 0 ? WaveSolver::Explicit : WaveSolver::Implicit;
+            Water pool(0.0f, 0.0f, length, 300.0f, options.columns);
+            for (size_t i = 0; i < pool.surfaceHeights.size(); i++)
+                pool.surfaceHeights[i] = static_cast<float>(waveBump(i * pool.dx, length));
+
+            const float stiffness = (params.waveSpeed / pool.dx) * (params.waveSpeed / pool.dx);
+            const int substeps = solver == WaveSolver::Implicit ? 1 :
+                static_cast<int>(std::ceil(dt / pool.maxStableStep(params.waveSpeed) - 0.0001f));
+            const float step = dt / substeps;
+
+            Measure measure;
+            for (int i = 0; i < options.steps; i++)
+            {
+                for (int k = 0; k < substeps; k++)
+                {
+                    if (solver == WaveSolver::Implicit)
+                        pool.solveImplicit(step, stiffness);
+                    else
+                        pool.propagateWaves(step, 1.0f, stiffness);
+                }
+            }
+            const double ns = measure.elapsedNs();
+
+            const double travelled = static_cast<double>(params.waveSpeed) * dt * options.steps;
+            double squared = 0.0;
+            for (size_t i = 0; i < pool.surfaceHeights.size(); i++)
+            {
+                const double error = pool.surfaceHeights[i] - exactWave(i * pool.dx, length, travelled);
+                squared += error * error;
+            }
+            const double rmsError = std::sqrt(squared / pool.surfaceHeights.size()) / waveBump(0.5 * length, length);
+
+            beginResult("waves");
+            std::printf(", \"solver\": \"%s\", \"columns\": %d, \"steps\": %d, \"substeps\": %d, \"ns_per_step\": %.1f, \"rms_error\": %.4f",
+                solver == WaveSolver::Implicit ? "implicit" : "explicit", options.columns, options.steps, substeps,
+                ns / options.steps, rmsError);
+            printAllocations(measure, options.steps);
+            endResult();
+        }
+    }
+
+    // Moves balls in a closed box and resolves their contacts with resolve,
+    // which is given the balls and calls BallCollisions::resolve per pair.
+    template <typename Resolve>
+    void stepBox(std::vector<Ball>& balls, float side, Resolve resolve)
+    {
+        for (Ball& ball : balls)
+        {
+            ball.update(kStep);
+            if ((ball.position.x < ball.radius && ball.velocity.x < 0) ||
+                (ball.position.x > side - ball.radius && ball.velocity.x > 0))
+                ball.velocity.x = -ball.velocity.x;
+            if ((ball.position.y < ball.radius && ball.velocity.y < 0) ||
+                (ball.position.y > side - ball.radius && ball.velocity.y > 0))
+                ball.velocity.y = -ball.velocity.y;
+        }
+        resolve(balls);
+    }
+
+    // Ball-ball contacts. Checks that the spatial hash finds exactly the
+    // overlapping pairs an all-pairs test finds, then times both resolving
+    // contacts between balls bouncing around a box. All-pairs is quadratic,
+    // so it runs fewer steps.
+    void runCollide(const Options& options)
+    {
+        const int count = options.collideBalls;
+        const float radius = 0.05f;
+        // The balls cover about 40% of the box.
+        const float side = std::sqrt(count * FastMath::kPi * radius * radius / 0.4f);
+
+        Random random(options.seed);
+        std::vector<Ball> initial;
+        initial.reserve(static_cast<size_t>(count));
+        for (int i = 0; i < count; i++)
+        {
+            initial.emplace_back(random.nextFloat(radius, side - radius), random.nextFloat(radius, side - radius), radius, 1.0f);
+            initial.back().velocity = sf::Vector2f(random.nextFloat(-1.0f, 1.0f), random.nextFloat(-1.0f, 1.0f));
+        }
+
+        BallCollisions collisions;
+        unsigned long long gridContacts = 0, gridChecksum = 0, allContacts = 0, allChecksum = 0;
+        collisions.forEachContact(initial, [&](size_t i, size_t j) {
+            gridContacts++;
+            gridChecksum += i * count + j;
+        });
+        BallCollisions::forEachContactAllPairs(initial, [&](size_t i, size_t j) {
+            allContacts++;
+            allChecksum += i * count + j;
+        });
+        const bool matches = gridContacts == allContacts && gridChecksum == allChecksum;
+        failed = failed || !matches;
+
+        // About a billion pair tests in all.
+        const double pairs = 0.5 * count * count;
+        const int allPairsSteps = std::max(1, std::min(options.steps, static_cast<int>(1e9 / pairs)));
+        std::vector<Ball> balls = initial;
+        Measure allMeasure;
+        for (int i = 0; i < allPairsSteps; i++)
+        {
+            stepBox(balls, side, [](std::vector<Ball>& b) {
+                BallCollisions::forEachContactAllPairs(b, [&b](size_t i, size_t j) {
+                    BallCollisions::resolve(b[i], b[j]);
+                });
+            });
+        }
+        const double allNs = allMeasure.elapsedNs() / allPairsSteps;
+
+        balls = initial;
+        auto gridResolve = [&collisions](std::vector<Ball>& b) { collisions.resolve(b); };
+        for (int i = 0; i < options.warmup; i++)
+            stepBox(balls, side, gridResolve);
+        Measure gridMeasure;
+        for (int i = 0; i < options.steps; i++)
+            stepBox(balls, side, gridResolve);
+        const double gridNs = gridMeasure.elapsedNs() / options.steps;
+
+        beginResult("collide");
+        std::printf(", \"balls\": %d, \"contacts\": %llu, \"matches_all_pairs\": %s, \"steps\": %d, \"ns_per_step\": %.1f"
+            ", \"all_pairs_steps\": %d, \"all_pairs_ns_per_step\": %.1f, \"speedup\": %.1f",
+            count, gridContacts, matches ? "true" : "false", options.steps, gridNs,
+            allPairsSteps, allNs, gridNs > 0 ? allNs / gridNs : 0.0);
+        printAllocations(gridMeasure, options.steps);
+        endResult();
+    }
+
+    // Runs every kernel set the CPU supports over the same particles and
+    // checks that each one matches the scalar reference bit for bit.
+    void runKernels(const Options& options)
+    {
+        const size_t n = static_cast<size_t>(options.particles);
+        Random random(options.seed);
+
+        std::vector<float> posX(n), posY(n), velX(n), velY(n), lifetime(n), invLife(n);
+        random.fillFloats(posX.data(), n, 0.0f, static_cast<float>(options.width));
+        random.fillFloats(posY.data(), n, 0.0f, static_cast<float>(options.height));
+        random.fillFloats(velX.data(), n, -300.0f, 300.0f);
+        random.fillFloats(velY.data(), n, -300.0f, 300.0f);
+        random.fillFloats(lifetime.data(), n, -0.1f, 2.5f);
+        random.fillFloats(invLife.data(), n, 0.5f, 3.0f);
+        for (float& inv : invLife)
+            inv = 1.0f / inv;
+
+        sf::Color lut[ParticleKernels::kLutSize];
+        ColorGradient::preset(ColorGradient::Preset::Fire).bake(lut, ParticleKernels::kLutSize);
+        std::vector<float> refX, refY, refVelY, refLife;
+        std::vector<sf::Color> refColors(n);
+
+        for (int i = 0; i < static_cast<int>(ParticleKernels::Isa::Count); i++)
+        {
+            ParticleKernels::Isa isa = static_cast<ParticleKernels::Isa>(i);
+            if (!ParticleKernels::isSupported(isa))
+                continue;
+            const ParticleKernels::KernelSet& kernels = ParticleKernels::get(isa);
+
+            std::vector<float> x = posX, y = posY, vy = velY, life = lifetime;
+            std::vector<sf::Color> colors(n);
+            kernels.integrate(x.data(), y.data(), velX.data(), vy.data(), kStep, n);
+            kernels.addGravity(vy.data(), 180.0f * kStep, n);
+            kernels.age(life.data(), kStep, n);
+            kernels.shadeColors(life.data(), invLife.data(), lut, colors.data(), n);
+
+            bool matches = true;
+            if (isa == ParticleKernels::Isa::Scalar)
+            {
+                refX = x;
+                refY = y;
+                refVelY = vy;
+                refLife = life;
+                refColors = colors;
+            }
+            else
+            {
+                matches = x == refX && y == refY && vy == refVelY && life == refLife &&
+                    std::memcmp(colors.data(), refColors.data(), n * sizeof(sf::Color)) == 0;
+                failed = failed || !matches;
+            }
+
+            Measure measure;
+            for (int s = 0; s < options.steps; s++)
+            {
+                kernels.integrate(x.data(), y.data(), velX.data(), vy.data(), kStep, n);
+                kernels.addGravity(vy.data(), 180.0f * kStep, n);
+                kernels.age(life.data(), kStep, n);
+                kernels.shadeColors(life.data(), invLife.data(), lut, colors.data(), n);
+            }
+            const double ns = measure.elapsedNs();
+
+            beginResult("kernels");
+            std::printf(", \"isa\": \"%s\", \"particles\": %d, \"steps\": %d, \"ns_per_particle\": %.4f, \"matches_scalar\": %s",
+                kernels.name, options.particles, options.steps, ns / (static_cast<double>(n) * options.steps),
+                matches ? "true" : "false");
+            endResult();
+        }
+    }
+
+    // Checks FastMath::sincos against double precision std::sin/std::cos over
+    // its whole documented range and times it against the float std calls.
+    // An error above FastMath::kMaxError fails the run.
+    void runTrig(const Options& options)
+    {
+        const int samples = 2000000;
+        double maxError = 0.0;
+        for (int i = 0; i <= samples; i++)
+        {
+            const float x = FastMath::kMaxArgument * (2.0f * i / samples - 1.0f);
+            float s, c;
+            FastMath::sincos(x, s, c);
+            maxError = std::max(maxError, std::fabs(s - std::sin(static_cast<double>(x))));
+            maxError = std::max(maxError, std::fabs(c - std::cos(static_cast<double>(x))));
+        }
+        const bool within = maxError <= FastMath::kMaxError;
+        failed = failed || !within;
+
+        const size_t n = static_cast<size_t>(options.particles);
+        std::vector<float> angles(n), sines(n), cosines(n);
+        Random random(options.seed);
+        random.fillFloats(angles.data(), n, -2.0f * FastMath::kPi, 2.0f * FastMath::kPi);
+
+        float sink = 0.0f;
+        Measure stdMeasure;
+        for (int step = 0; step < options.steps; step++)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                sines[i] = std::sin(angles[i]);
+                cosines[i] = std::cos(angles[i]);
+            }
+            sink += sines[step % n] + cosines[step % n];
+        }
+        const double stdNs = stdMeasure.elapsedNs() / (static_cast<double>(n) * options.steps);
+
+        Measure fastMeasure;
+        for (int step = 0; step < options.steps; step++)
+        {
+            FastMath::sincos(angles.data(), sines.data(), cosines.data(), n);
+            sink += sines[step % n] + cosines[step % n];
+        }
+        const double fastNs = fastMeasure.elapsedNs() / (static_cast<double>(n) * options.steps);
+
+        beginResult("trig");
+        std::printf(", \"samples\": %d, \"max_error\": %.3g, \"bound\": %.3g, \"within_bound\": %s"
+            ", \"std_ns\": %.3f, \"fast_ns\": %.3f, \"checksum\": %.1f",
+            samples, maxError, static_cast<double>(FastMath::kMaxError), within ? "true" : "false",
+            stdNs, fastNs, sink);
+        endResult();
+    }
+
+    // Compares the C library rand() the particles used to draw from with
+    // Random, both producing floats in [0, 1).
+    void runRandom(const Options& options)
+    {
+        const int count = 10000000;
+        std::vector<float> out(4096);
+
+        std::srand(static_cast<unsigned>(options.seed));
+        float sink = 0.0f;
+        Measure randMeasure;
+        for (int i = 0; i < count; i++)
+            sink += static_cast<float>(std::rand()) / (static_cast<float>(RAND_MAX) + 1.0f);
+        const double randNs = randMeasure.elapsedNs() / count;
+
+        Random random(options.seed);
+        Measure nextMeasure;
+        for (int i = 0; i < count; i++)
+            sink += random.nextFloat();
+        const double nextNs = nextMeasure.elapsedNs() / count;
+
+        Measure fillMeasure;
+        for (int i = 0; i < count; i += static_cast<int>(out.size()))
+        {
+            random.fillFloats(out.data(), out.size());
+            sink += out[i % out.size()];
+        }
+        const double fillNs = fillMeasure.elapsedNs() / count;
+
+        beginResult("random");
+        std::printf(", \"count\": %d, \"rand_ns\": %.3f, \"next_float_ns\": %.3f, \"fill_floats_ns\": %.3f, \"checksum\": %.1f",
+            count, randNs, nextNs, fillNs, sink);
+        endResult();
+    }
+
+    bool parseShape(const char* name, Options& options)
+    {
+        options.allShapes = std::strcmp(name, "all") == 0;
+        if (options.allShapes)
+            return true;
+
+        for (int i = 0; i < static_cast<int>(ParticleSys::ParticleShape::Count); i++)
+        {
+            const ParticleSys::ParticleShape shape = static_cast<ParticleSys::ParticleShape>(i);
+            if (shapeId(shape) == name)
+            {
+                options.shape = shape;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char* arg = argv[i];
+            if (i + 1 >= argc)
+                return false;
+            const char* value = argv[++i];
+
+            if (std::strcmp(arg, "--scene") == 0)
+                options.scene = value;
+            else if (std::strcmp(arg, "--steps") == 0)
+                options.steps = std::atoi(value);
+            else if (std::strcmp(arg, "--warmup") == 0)
+                options.warmup = std::atoi(value);
+            else if (std::strcmp(arg, "--seed") == 0)
+                options.seed = std::strtoull(value, nullptr, 10);
+            else if (std::strcmp(arg, "--width") == 0)
+                options.width = static_cast<unsigned>(std::atoi(value));
+            else if (std::strcmp(arg, "--height") == 0)
+                options.height = static_cast<unsigned>(std::atoi(value));
+            else if (std::strcmp(arg, "--particles") == 0)
+                options.particles = std::atoi(value);
+            else if (std::strcmp(arg, "--emitters") == 0)
+                options.emitters = std::atoi(value);
+            else if (std::strcmp(arg, "--threads") == 0)
+                options.threads = static_cast<unsigned>(std::atoi(value));
+            else if (std::strcmp(arg, "--balls") == 0)
+                options.balls = std::atoi(value);
+            else if (std::strcmp(arg, "--columns") == 0)
+                options.columns = std::atoi(value);
+            else if (std::strcmp(arg, "--collide-balls") == 0)
+                options.collideBalls = std::atoi(value);
+            else if (std::strcmp(arg, "--render-balls") == 0)
+                options.renderBalls = std::atoi(value);
+            else if (std::strcmp(arg, "--shape") == 0)
+            {
+                if (!parseShape(value, options))
+                    return false;
+            }
+            else
+                return false;
+        }
+        static const char* scenes[] = { "all", "fire", "layout", "water", "balls", "waves", "collide", "light", "kernels", "trig", "random" };
+        bool knownScene = false;
+        for (const char* scene : scenes)
+            knownScene = knownScene || options.scene == scene;
+
+        return knownScene && options.steps > 0 && options.warmup >= 0 && options.particles > 0 &&
+            options.emitters > 0 && options.threads > 0 && options.balls >= 0 && options.columns > 1 && options.collideBalls > 0 &&
+            options.renderBalls > 0 && options.width > 0 && options.height > 0;
+    }
+
+    bool runs(const Options& options, const char* scene)
+    {
+        return options.scene == "all" || options.scene == scene;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::string shapes = "all";
+        for (int i = 0; i < static_cast<int>(ParticleSys::ParticleShape::Count); i++)
+            shapes += "|" + shapeId(static_cast<ParticleSys::ParticleShape>(i));
+
+        std::fprintf(stderr,
+            "usage: Bench [--scene all|fire|layout|water|balls|waves|collide|light|kernels|trig|random] [--steps N] [--warmup N]\n"
+            "             [--seed N] [--width N] [--height N] [--particles N] [--emitters N]\n"
+            "             [--shape %s] [--threads N] [--balls N] [--columns N] [--collide-balls N]\n"
+            "             [--render-balls N]\n", shapes.c_str());
+        return 1;
+    }
+
+    std::printf("{\n  \"seed\": %llu, \"width\": %u, \"height\": %u, \"kernels\": \"%s\",\n  \"results\": [",
+        static_cast<unsigned long long>(options.seed), options.width, options.height, ParticleKernels::best().name);
+
+    if (runs(options, "fire"))
+    {
+        if (options.allShapes)
+        {
+            for (int i = 0; i < static_cast<int>(ParticleSys::ParticleShape::Count); i++)
+                runFire(options, static_cast<ParticleSys::ParticleShape>(i));
+        }
+        else
+        {
+            runFire(options, options.shape);
+        }
+    }
+    if (runs(options, "layout"))
+        runLayout(options);
+    if (runs(options, "water"))
+        runWater(options);
+    if (runs(options, "balls"))
+        runBalls(options);
+    if (runs(options, "waves"))
+        runWaves(options);
+    if (runs(options, "collide"))
+        runCollide(options);
+    if (runs(options, "light"))
+        runLight(options);
+    if (runs(options, "kernels"))
+        runKernels(options);
+    if (runs(options, "trig"))
+        runTrig(options);
+    if (runs(options, "random"))
+        runRandom(options);
+
+    std::printf("\n  ]\n}\n");
+
+    // A kernel set that disagrees with the scalar reference, fast trig
+    // outside its error bound, contacts missed by the collision grid, balls
+    // stepped differently on several threads, or a scene allocating in
+    // steady state fails the run.
+    return failed ? 2 : 0;
+}
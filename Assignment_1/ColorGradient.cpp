@@ -0,0 +1,136 @@
+#include "ColorGradient.h"
+#include <algorithm>
+
+namespace
+{
+    sf::Uint8 mix(sf::Uint8 a, sf::Uint8 b, float f)
+    {
+        return static_cast<sf::Uint8>(a + (b - a) * f + 0.5f);
+    }
+}
+
+ColorGradient ColorGradient::preset(Preset preset)
+{
+    ColorGradient g;
+
+    switch (preset)
+    {
+    case Preset::Fire:
+        // Hot white-yellow core cooling through orange and red into smoke.
+        g.addStop(0.00f, sf::Color(255, 250, 210, 255));
+        g.addStop(0.12f, sf::Color(255, 210, 80, 255));
+        g.addStop(0.35f, sf::Color(255, 120, 20, 235));
+        g.addStop(0.65f, sf::Color(190, 40, 10, 170));
+        g.addStop(0.85f, sf::Color(70, 55, 50, 80));
+        g.addStop(1.00f, sf::Color(40, 40, 40, 0));
+        break;
+    case Preset::BlueFlame:
+        g.addStop(0.00f, sf::Color(220, 240, 255, 255));
+        g.addStop(0.25f, sf::Color(90, 150, 255, 235));
+        g.addStop(0.65f, sf::Color(40, 50, 210, 150));
+        g.addStop(1.00f, sf::Color(10, 10, 60, 0));
+        break;
+    case Preset::Embers:
+        g.addStop(0.00f, sf::Color(255, 220, 120, 255));
+        g.addStop(0.30f, sf::Color(255, 120, 20, 255));
+        g.addStop(0.80f, sf::Color(160, 30, 0, 200));
+        g.addStop(1.00f, sf::Color(60, 0, 0, 0));
+        break;
+    case Preset::Sparks:
+        g.addStop(0.00f, sf::Color(255, 255, 255, 255));
+        g.addStop(0.20f, sf::Color(255, 230, 120, 255));
+        g.addStop(0.70f, sf::Color(255, 140, 30, 180));
+        g.addStop(1.00f, sf::Color(255, 60, 0, 0));
+        break;
+    case Preset::Classic:
+    default:
+        // The original look: the base colour with green, blue and alpha
+        // fading out together.
+        g.addStop(0.00f, sf::Color(255, 100, 30, 255));
+        g.addStop(1.00f, sf::Color(255, 0, 0, 0));
+        break;
+    }
+    return g;
+}
+
+const char* ColorGradient::presetName(Preset preset)
+{
+    static const char* names[] = { "Fire", "Blue Flame", "Embers", "Sparks", "Classic" };
+    const int index = static_cast<int>(preset);
+    return index >= 0 && index < static_cast<int>(Preset::Count) ? names[index] : "";
+}
+
+bool ColorGradient::addStop(float position, sf::Color color)
+{
+    if (count >= kMaxStops)
+        return false;
+
+    stops[count].position = std::max(0.0f, std::min(position, 1.0f));
+    stops[count].color = color;
+    count++;
+    return true;
+}
+
+void ColorGradient::removeStop(int index)
+{
+    if (index < 0 || index >= count)
+        return;
+
+    for (int i = index; i + 1 < count; i++)
+        stops[i] = stops[i + 1];
+    count--;
+}
+
+sf::Color ColorGradient::sample(float t) const
+{
+    if (count == 0)
+        return sf::Color::White;
+
+    // Nearest stop at or before t and nearest at or after it; stops are not
+    // kept sorted, so both are found in one pass.
+    const Stop* below = nullptr;
+    const Stop* above = nullptr;
+    for (int i = 0; i < count; i++)
+    {
+        const Stop& s = stops[i];
+        if (s.position <= t && (below == nullptr || s.position >= below->position))
+            below = &s;
+        if (s.position >= t && (above == nullptr || s.position < above->position))
+            above = &s;
+    }
+
+    if (below == nullptr)
+        return above->color;
+    if (above == nullptr)
+        return below->color;
+
+    const float span = above->position - below->position;
+    const float f = span > 0.0f ? (t - below->position) / span : 0.0f;
+
+    sf::Color c;
+    c.r = mix(below->color.r, above->color.r, f);
+    c.g = mix(below->color.g, above->color.g, f);
+    c.b = mix(below->color.b, above->color.b, f);
+    c.a = mix(below->color.a, above->color.a, f);
+    return c;
+}
+
+void ColorGradient::bake(sf::Color* lut, std::size_t size) const
+{
+    const float scale = size > 1 ? 1.0f / static_cast<float>(size - 1) : 0.0f;
+    for (std::size_t i = 0; i < size; i++)
+        lut[i] = sample(static_cast<float>(i) * scale);
+}
+
+bool ColorGradient::operator==(const ColorGradient& other) const
+{
+    if (count != other.count)
+        return false;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (stops[i].position != other.stops[i].position || stops[i].color != other.stops[i].color)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <cstddef>
+
+// Colour and alpha over a particle's life. Stops are kept in a fixed array so
+// copying emitter settings never allocates. They are never sorted and may be
+// in any order: sample() finds the nearest stop on either side of an age in
+// one pass over all of them.
+struct ColorGradient
+{
+    enum class Preset { Fire, BlueFlame, Embers, Sparks, Classic, Count };
+
+    struct Stop
+    {
+        // Normalized age in [0, 1]: 0 at spawn, 1 when the particle dies.
+        float position = 0.0f;
+        sf::Color color;
+    };
+
+    static const int kMaxStops = 8;
+
+    Stop stops[kMaxStops];
+    int count = 0;
+
+    static ColorGradient preset(Preset preset);
+    static const char* presetName(Preset preset);
+
+    // Returns false when the gradient already has kMaxStops stops.
+    bool addStop(float position, sf::Color color);
+    void removeStop(int index);
+
+    // Colour at normalized age t, interpolated between the nearest stops.
+    sf::Color sample(float t) const;
+
+    // Samples size evenly spaced ages from 0 to 1 into lut.
+    void bake(sf::Color* lut, std::size_t size) const;
+
+    // Same stops in the same order.
+    bool operator==(const ColorGradient& other) const;
+    bool operator!=(const ColorGradient& other) const { return !(*this == other); }
+};
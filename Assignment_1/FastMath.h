@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Polynomial sine and cosine for the particle emitters.
+//
+// The argument is reduced to r in [-pi/4, pi/4] around the nearest multiple
+// of pi/2 (with pi/2 split into three parts, Cody-Waite style) and both
+// results come from minimax polynomials on r (the Cephes sinf/cosf
+// coefficients). There are no branches or table lookups, so loops over
+// sincos() vectorize.
+//
+// Error bound: for |x| <= kMaxArgument the absolute error of both results is
+// below kMaxError, checked against double precision std::sin and std::cos by
+// the benchmark's "trig" scene. Beyond kMaxArgument the reduction loses
+// accuracy; the emitters only pass angles in [-2pi, 2pi] and small steps.
+namespace FastMath
+{
+    const float kPi = 3.14159265358979f;
+    const float kMaxArgument = 8192.0f;
+    const float kMaxError = 1.5e-7f;
+
+    inline uint32_t toBits(float f)
+    {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    inline float fromBits(uint32_t u)
+    {
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    inline void sincos(float x, float& s, float& c)
+    {
+        const float twoOverPi = 0.636619772367581f;
+        const float pio2a = 1.5703125f;
+        const float pio2b = 4.837512969970703125e-4f;
+        const float pio2c = 7.54978995489188216e-8f;
+        // 1.5 * 2^23: adding and subtracting it rounds to the nearest integer.
+        const float roundMagic = 12582912.0f;
+
+        // Nearest multiple of pi/2.
+        const float fj = (x * twoOverPi + roundMagic) - roundMagic;
+        const int32_t j = static_cast<int32_t>(fj);
+        const float r = ((x - fj * pio2a) - fj * pio2b) - fj * pio2c;
+        const float r2 = r * r;
+
+        const float sr = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+        const float cr = 1.0f - 0.5f * r2 +
+            r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+        // Quadrant j mod 4 swaps the two results and flips their signs. It is
+        // applied with bit masks rather than selects so the loop stays free
+        // of branches.
+        const uint32_t swap = 0u - static_cast<uint32_t>(j & 1);
+        const uint32_t sinSign = static_cast<uint32_t>(j & 2) << 30;
+        const uint32_t cosSign = static_cast<uint32_t>((j + 1) & 2) << 30;
+        const uint32_t sb = toBits(sr);
+        const uint32_t cb = toBits(cr);
+        s = fromBits(((sb & ~swap) | (cb & swap)) ^ sinSign);
+        c = fromBits(((cb & ~swap) | (sb & swap)) ^ cosSign);
+    }
+
+    inline void sincos(const float* x, float* s, float* c, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+            sincos(x[i], s[i], c[i]);
+    }
+}
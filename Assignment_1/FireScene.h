@@ -1,13 +1,15 @@
 #pragma once
 #include "SceneInterface.h"
 #include "ParticleSys.h"
+#include "ParticleUI.h"
 
 class FireScene : public SceneInterface {
     ParticleSys particles;
+    ParticleUI ui;
     sf::Vector2u windowSize;
 
 public:
-    FireScene() {
+    FireScene() : ui(particles.getParams()) {
         windowSize = sf::Vector2u(1280 / 2, 720 / 2);
         particles.init(windowSize);
     }
@@ -16,15 +18,30 @@ public:
         if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
             sf::Vector2i clickPosition = sf::Mouse::getPosition(window);
             sf::Vector2f worldPos = window.mapPixelToCoords(clickPosition);
-            particles.init(sf::Vector2u(worldPos));
+            particles.addEmitter(worldPos);
         }
     }
 
     void update(float dt) override {
-        particles.update();
+        particles.update(dt);
     }
 
-    void render(sf::RenderWindow& window) override {
-        particles.draw(window);
+    void renderGUI() override {
+        ui.draw(particles);
+    }
+
+    void applyParams() override {
+        ParticleSys::Params params;
+        if (ui.takeChanges(params)) {
+            particles.setParams(params);
+        }
+        uint64_t seed;
+        if (ui.takeReplay(seed)) {
+            particles.setSeed(seed);
+        }
+    }
+
+    void render(sf::RenderWindow& window, float alpha) override {
+        particles.draw(window, alpha);
     }
 };
@@ -1,5 +1,6 @@
 #pragma once
 #include "SceneInterface.h"
+#include "Profiler.h"
 #include <SFML/Graphics.hpp>
 #include <vector>
 #include <cmath>
@@ -53,12 +54,8 @@ Intersect LineIntersect(sf::Vector2f a, sf::Vector2f b, sf::Vector2f c, sf::Vect
 
 void drawLine(sf::Vector2f p1, sf::Vector2f p2, sf::RenderWindow& window, sf::Color color)
 {
-    sf::VertexArray line(sf::Lines, 2);
-    line[0].position = p1;
-    line[0].color = color;
-    line[1].position = p2;
-    line[1].color = color;
-    window.draw(line);
+    const sf::Vertex line[] = { sf::Vertex(p1, color), sf::Vertex(p2, color) };
+    window.draw(line, 2, sf::Lines);
 }
 
 sf::Vector2f rotateVector(const sf::Vector2f& vec, float angle)
@@ -71,10 +68,10 @@ sf::Vector2f rotateVector(const sf::Vector2f& vec, float angle)
     );
 }
 
-Intersect drawRayWithIntersection(sf::CircleShape& player, sf::Vector2f& target, std::vector<ShapeEntity>& shapes, sf::RenderWindow& window,
-    float angleOffset = 0, bool isLineDraw = 0)
+// Closest hit of the ray from start towards target, rotated by angleOffset,
+// against the edges of all shapes. Does not draw anything.
+Intersect castRay(sf::Vector2f start, sf::Vector2f target, const std::vector<ShapeEntity>& shapes, float angleOffset = 0)
 {
-    sf::Vector2f start(player.getPosition().x + player.getRadius(), player.getPosition().y + player.getRadius());
     sf::Vector2f direction = target - start;
     direction = rotateVector(direction, angleOffset);
 
@@ -95,17 +92,18 @@ Intersect drawRayWithIntersection(sf::CircleShape& player, sf::Vector2f& target,
             }
         }
     }
-    if (isLineDraw)
-    {
-        drawLine(start, closestIntersect.pos, window, sf::Color(127, 0, 255));
-    }
     return closestIntersect;
 }
+
 class LightScene : public SceneInterface {
     std::vector<ShapeEntity> shapes;
     sf::CircleShape player;
     bool isLinesDraw = false;
     bool isPolygonDraw = true;
+    // Ray hits of the last castRays() call; the first four are the corners.
+    std::vector<sf::Vector2f> intersectPos;
+    // Triangles of the light polygon, refilled in place every frame.
+    sf::VertexArray lightPolygon;
 
     static float angleBetween(const sf::Vector2f& p1, const sf::Vector2f& p2) {
         return std::atan2(p2.y - p1.y, p2.x - p1.x);
@@ -123,6 +121,8 @@ public:
         player.setPointCount(20);
         player.setFillColor(sf::Color(127, 0, 255));
         player.setRadius(3);
+
+        lightPolygon.setPrimitiveType(sf::Triangles);
     }
 
     void handleEvent(const sf::Event& event, sf::RenderWindow& window) override {
@@ -154,81 +154,93 @@ public:
 
         }
     }
-    void update(float dt) override {
-       
+    void setPlayerPosition(sf::Vector2f position) {
+        player.setPosition(position.x - player.getRadius(), position.y - player.getRadius());
     }
 
-    void render(sf::RenderWindow& window) override {
-        sf::Vector2f topLeft(0, 0);
-        sf::Vector2f topRight(window.getSize().x, 0);
-        sf::Vector2f bottomLeft(0, window.getSize().y);
-        sf::Vector2f bottomRight(window.getSize().x, window.getSize().y);
-
-        for (const auto& shape : shapes)
+    // Casts one ray at every view corner and three at every shape vertex
+    // from the player's centre and returns how many were cast. No window is
+    // needed, so the ray caster can also run headless.
+    size_t castRays(sf::Vector2f viewSize) {
+        PROFILE_ZONE("Light/Cast Rays");
+        sf::Vector2f start = player.getPosition() + sf::Vector2f(player.getRadius(), player.getRadius());
+        const sf::Vector2f corners[] = {
+            sf::Vector2f(0, 0), sf::Vector2f(viewSize.x, 0), sf::Vector2f(0, viewSize.y), viewSize
+        };
+
+        intersectPos.clear();
+        for (const auto& corner : corners)
         {
-            window.draw(shape.shape);
-        }
-
-        std::vector<sf::Vector2f> intersectPos;
-
-        std::vector<sf::Vector2f> corners = { topLeft, topRight, bottomLeft, bottomRight };
-
-        for (auto& corner : corners)
-        {
-            intersectPos.push_back(drawRayWithIntersection(player, corner, shapes, window).pos);
+            intersectPos.push_back(castRay(start, corner, shapes).pos);
         }
 
         for (const auto& shape : shapes)
         {
             for (size_t i = 0; i < shape.shape.getPointCount(); ++i)
             {
-                if (isLinesDraw)
-                {
-                    sf::Vector2f vertex = shape.shape.getTransform().transformPoint(shape.shape.getPoint(i));
-                    intersectPos.push_back(drawRayWithIntersection(player, vertex, shapes, window, 0.00001f, true).pos);
-                    intersectPos.push_back(drawRayWithIntersection(player, vertex, shapes, window, 0, true).pos);
-                    intersectPos.push_back(drawRayWithIntersection(player, vertex, shapes, window, -0.00001f, true).pos);
-                }
-                else
-                {
-                    sf::Vector2f vertex = shape.shape.getTransform().transformPoint(shape.shape.getPoint(i));
-                    intersectPos.push_back(drawRayWithIntersection(player, vertex, shapes, window, 0.00001f).pos);
-                    intersectPos.push_back(drawRayWithIntersection(player, vertex, shapes, window).pos);
-                    intersectPos.push_back(drawRayWithIntersection(player, vertex, shapes, window, -0.00001f).pos);
-                }
-
+                sf::Vector2f vertex = shape.shape.getTransform().transformPoint(shape.shape.getPoint(i));
+                intersectPos.push_back(castRay(start, vertex, shapes, 0.00001f).pos);
+                intersectPos.push_back(castRay(start, vertex, shapes).pos);
+                intersectPos.push_back(castRay(start, vertex, shapes, -0.00001f).pos);
             }
         }
+        return intersectPos.size();
+    }
 
+    // Orders the hits by angle around the player to form the light polygon.
+    void sortIntersections() {
+        PROFILE_ZONE("Light/Sort");
         sf::Vector2f playerCenter = player.getPosition() + sf::Vector2f(player.getRadius(), player.getRadius());
 
         std::sort(intersectPos.begin(), intersectPos.end(), [&playerCenter](const sf::Vector2f& a, const sf::Vector2f& b)
             {
                 return angleBetween(playerCenter, a) < angleBetween(playerCenter, b);
             });
+    }
 
-        if (isPolygonDraw)
+    // Fans the sorted hits around the player into triangles, wrapping from
+    // the last hit back to the first.
+    const sf::VertexArray& buildLightPolygon() {
+        PROFILE_ZONE("Light/Polygons");
+        const sf::Color color(127, 0, 255, 40);
+        const size_t count = intersectPos.size();
+        lightPolygon.resize(count * 3);
+        for (size_t i = 0; i < count; i++)
+        {
+            lightPolygon[3 * i] = sf::Vertex(intersectPos[i], color);
+            lightPolygon[3 * i + 1] = sf::Vertex(player.getPosition(), color);
+            lightPolygon[3 * i + 2] = sf::Vertex(intersectPos[i + 1 < count ? i + 1 : 0], color);
+        }
+        return lightPolygon;
+    }
+
+    void update(float dt) override {
+       
+    }
+
+    void render(sf::RenderWindow& window, float alpha) override {
+        for (const auto& shape : shapes)
         {
-            for (size_t i = 0; i < intersectPos.size(); i++)
+            window.draw(shape.shape);
+        }
+
+        castRays(sf::Vector2f(window.getSize()));
+
+        if (isLinesDraw)
+        {
+            sf::Vector2f start = player.getPosition() + sf::Vector2f(player.getRadius(), player.getRadius());
+            for (size_t i = 4; i < intersectPos.size(); i++)
             {
-                sf::ConvexShape polygon;
-                polygon.setPointCount(3);
-                if (i == intersectPos.size() - 1)
-                {
-                    polygon.setPoint(0, intersectPos[0]);
-                    polygon.setPoint(1, player.getPosition());
-                    polygon.setPoint(2, intersectPos[i]);
-                }
-                else
-                {
-                    polygon.setPoint(0, intersectPos[i]);
-                    polygon.setPoint(1, player.getPosition());
-                    polygon.setPoint(2, intersectPos[i + 1]);
-                }
-                polygon.setFillColor(sf::Color(127, 0, 255, 40));
-                window.draw(polygon);
+                drawLine(start, intersectPos[i], window, sf::Color(127, 0, 255));
             }
-        }   
+        }
+
+        sortIntersections();
+
+        if (isPolygonDraw)
+        {
+            window.draw(buildLightPolygon());
+        }
         window.draw(player);
 
     }
@@ -0,0 +1,341 @@
+#include "ParticleKernels.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC accepts any intrinsic in any function; GCC and Clang need the wider
+// instruction sets enabled per function so the rest of the file stays SSE2.
+#if defined(PARTICLE_KERNELS_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// AVX-512 implies FMA, and GCC would otherwise fuse the multiply-adds in the
+// vector kernels, which then no longer match the scalar reference exactly.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+namespace
+{
+    // ---- Scalar reference -------------------------------------------------
+
+    const float kLutScale = static_cast<float>(ParticleKernels::kLutSize - 1);
+
+    inline int lutIndex(float lifetime, float invLife)
+    {
+        float age = 1.0f - lifetime * invLife;
+        age = std::max(0.0f, std::min(age, 1.0f));
+        return static_cast<int>(age * kLutScale);
+    }
+
+    void integrateScalar(float* posX, float* posY, const float* velX, const float* velY, float dt, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            posX[i] += velX[i] * dt;
+            posY[i] += velY[i] * dt;
+        }
+    }
+
+    void addGravityScalar(float* velY, float dv, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+            velY[i] += dv;
+    }
+
+    void ageScalar(float* lifetime, float dt, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+            lifetime[i] -= dt;
+    }
+
+    void shadeColorsScalar(const float* lifetime, const float* invLife, const sf::Color* lut, sf::Color* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+            out[i] = lut[lutIndex(lifetime[i], invLife[i])];
+    }
+
+#ifdef PARTICLE_KERNELS_X86
+
+    // ---- SSE2 -------------------------------------------------------------
+
+    void integrateSSE2(float* posX, float* posY, const float* velX, const float* velY, float dt, std::size_t n)
+    {
+        const __m128 step = _mm_set1_ps(dt);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm_storeu_ps(posX + i, _mm_add_ps(_mm_loadu_ps(posX + i), _mm_mul_ps(_mm_loadu_ps(velX + i), step)));
+            _mm_storeu_ps(posY + i, _mm_add_ps(_mm_loadu_ps(posY + i), _mm_mul_ps(_mm_loadu_ps(velY + i), step)));
+        }
+        integrateScalar(posX + i, posY + i, velX + i, velY + i, dt, n - i);
+    }
+
+    void addGravitySSE2(float* velY, float dv, std::size_t n)
+    {
+        const __m128 g = _mm_set1_ps(dv);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(velY + i, _mm_add_ps(_mm_loadu_ps(velY + i), g));
+        addGravityScalar(velY + i, dv, n - i);
+    }
+
+    void ageSSE2(float* lifetime, float dt, std::size_t n)
+    {
+        const __m128 step = _mm_set1_ps(dt);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(lifetime + i, _mm_sub_ps(_mm_loadu_ps(lifetime + i), step));
+        ageScalar(lifetime + i, dt, n - i);
+    }
+
+    void shadeColorsSSE2(const float* lifetime, const float* invLife, const sf::Color* lut, sf::Color* out, std::size_t n)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(kLutScale);
+
+        // SSE2 has no gather: the indices are computed four at a time and the
+        // table is read with scalar loads.
+        alignas(16) int index[4];
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 age = _mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(lifetime + i), _mm_loadu_ps(invLife + i)));
+            age = _mm_max_ps(zero, _mm_min_ps(age, one));
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(_mm_mul_ps(age, scale)));
+
+            out[i] = lut[index[0]];
+            out[i + 1] = lut[index[1]];
+            out[i + 2] = lut[index[2]];
+            out[i + 3] = lut[index[3]];
+        }
+        shadeColorsScalar(lifetime + i, invLife + i, lut, out + i, n - i);
+    }
+
+    // ---- AVX2 -------------------------------------------------------------
+
+    TARGET_AVX2 void integrateAVX2(float* posX, float* posY, const float* velX, const float* velY, float dt, std::size_t n)
+    {
+        const __m256 step = _mm256_set1_ps(dt);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            _mm256_storeu_ps(posX + i, _mm256_add_ps(_mm256_loadu_ps(posX + i), _mm256_mul_ps(_mm256_loadu_ps(velX + i), step)));
+            _mm256_storeu_ps(posY + i, _mm256_add_ps(_mm256_loadu_ps(posY + i), _mm256_mul_ps(_mm256_loadu_ps(velY + i), step)));
+        }
+        integrateScalar(posX + i, posY + i, velX + i, velY + i, dt, n - i);
+    }
+
+    TARGET_AVX2 void addGravityAVX2(float* velY, float dv, std::size_t n)
+    {
+        const __m256 g = _mm256_set1_ps(dv);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(velY + i, _mm256_add_ps(_mm256_loadu_ps(velY + i), g));
+        addGravityScalar(velY + i, dv, n - i);
+    }
+
+    TARGET_AVX2 void ageAVX2(float* lifetime, float dt, std::size_t n)
+    {
+        const __m256 step = _mm256_set1_ps(dt);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(lifetime + i, _mm256_sub_ps(_mm256_loadu_ps(lifetime + i), step));
+        ageScalar(lifetime + i, dt, n - i);
+    }
+
+    TARGET_AVX2 void shadeColorsAVX2(const float* lifetime, const float* invLife, const sf::Color* lut, sf::Color* out, std::size_t n)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 scale = _mm256_set1_ps(kLutScale);
+        const int* table = reinterpret_cast<const int*>(lut);
+
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 age = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_loadu_ps(lifetime + i), _mm256_loadu_ps(invLife + i)));
+            age = _mm256_max_ps(zero, _mm256_min_ps(age, one));
+            __m256i index = _mm256_cvttps_epi32(_mm256_mul_ps(age, scale));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(table, index, 4));
+        }
+        shadeColorsScalar(lifetime + i, invLife + i, lut, out + i, n - i);
+    }
+
+    // ---- AVX-512 ----------------------------------------------------------
+
+    TARGET_AVX512 void integrateAVX512(float* posX, float* posY, const float* velX, const float* velY, float dt, std::size_t n)
+    {
+        const __m512 step = _mm512_set1_ps(dt);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            _mm512_storeu_ps(posX + i, _mm512_add_ps(_mm512_loadu_ps(posX + i), _mm512_mul_ps(_mm512_loadu_ps(velX + i), step)));
+            _mm512_storeu_ps(posY + i, _mm512_add_ps(_mm512_loadu_ps(posY + i), _mm512_mul_ps(_mm512_loadu_ps(velY + i), step)));
+        }
+        integrateScalar(posX + i, posY + i, velX + i, velY + i, dt, n - i);
+    }
+
+    TARGET_AVX512 void addGravityAVX512(float* velY, float dv, std::size_t n)
+    {
+        const __m512 g = _mm512_set1_ps(dv);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(velY + i, _mm512_add_ps(_mm512_loadu_ps(velY + i), g));
+        addGravityScalar(velY + i, dv, n - i);
+    }
+
+    TARGET_AVX512 void ageAVX512(float* lifetime, float dt, std::size_t n)
+    {
+        const __m512 step = _mm512_set1_ps(dt);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps(lifetime + i, _mm512_sub_ps(_mm512_loadu_ps(lifetime + i), step));
+        ageScalar(lifetime + i, dt, n - i);
+    }
+
+    TARGET_AVX512 void shadeColorsAVX512(const float* lifetime, const float* invLife, const sf::Color* lut, sf::Color* out, std::size_t n)
+    {
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 scale = _mm512_set1_ps(kLutScale);
+        // The unmasked min, max, convert and gather pass GCC's undefined
+        // placeholder as their merge source, which -Wmaybe-uninitialized
+        // flags. The masked forms with every lane set and an explicit zero
+        // source compile to the same instructions.
+        const __mmask16 all = 0xFFFF;
+        const __m512i zeroInt = _mm512_setzero_si512();
+
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m512 age = _mm512_sub_ps(one, _mm512_mul_ps(_mm512_loadu_ps(lifetime + i), _mm512_loadu_ps(invLife + i)));
+            age = _mm512_mask_max_ps(zero, all, zero, _mm512_mask_min_ps(zero, all, age, one));
+            __m512i index = _mm512_mask_cvttps_epi32(zeroInt, all, _mm512_mul_ps(age, scale));
+            _mm512_storeu_si512(out + i, _mm512_mask_i32gather_epi32(zeroInt, all, index, lut, 4));
+        }
+        shadeColorsScalar(lifetime + i, invLife + i, lut, out + i, n - i);
+    }
+
+    // ---- CPU detection ----------------------------------------------------
+
+    void cpuid(int leaf, int subleaf, unsigned regs[4])
+    {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; i++)
+            regs[i] = static_cast<unsigned>(r[i]);
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    unsigned long long xgetbv0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+
+    bool detect(ParticleKernels::Isa isa)
+    {
+        using ParticleKernels::Isa;
+        unsigned regs[4];
+        cpuid(0, 0, regs);
+        const unsigned maxLeaf = regs[0];
+
+        cpuid(1, 0, regs);
+        const bool sse2 = (regs[3] & (1u << 26)) != 0;
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        const bool avx = (regs[2] & (1u << 28)) != 0;
+
+        if (isa == Isa::SSE2)
+            return sse2;
+        if (!osxsave || !avx || maxLeaf < 7)
+            return false;
+
+        // The OS must save the YMM (and for AVX-512 the ZMM/opmask) state.
+        const unsigned long long xcr0 = xgetbv0();
+        cpuid(7, 0, regs);
+
+        if (isa == Isa::AVX2)
+            return (xcr0 & 0x6) == 0x6 && (regs[1] & (1u << 5)) != 0;
+        if (isa == Isa::AVX512)
+            return (xcr0 & 0xE6) == 0xE6 && (regs[1] & (1u << 16)) != 0;
+        return false;
+    }
+
+#endif // PARTICLE_KERNELS_X86
+
+    const ParticleKernels::KernelSet kKernelSets[] = {
+        { ParticleKernels::Isa::Scalar, "Scalar", integrateScalar, addGravityScalar, ageScalar, shadeColorsScalar },
+#ifdef PARTICLE_KERNELS_X86
+        { ParticleKernels::Isa::SSE2, "SSE2", integrateSSE2, addGravitySSE2, ageSSE2, shadeColorsSSE2 },
+        { ParticleKernels::Isa::AVX2, "AVX2", integrateAVX2, addGravityAVX2, ageAVX2, shadeColorsAVX2 },
+        { ParticleKernels::Isa::AVX512, "AVX-512", integrateAVX512, addGravityAVX512, ageAVX512, shadeColorsAVX512 },
+#endif
+    };
+}
+
+namespace ParticleKernels
+{
+    bool isSupported(Isa isa)
+    {
+        if (isa == Isa::Scalar)
+            return true;
+#ifdef PARTICLE_KERNELS_X86
+        static const bool supported[] = {
+            true,
+            detect(Isa::SSE2),
+            detect(Isa::AVX2),
+            detect(Isa::AVX512),
+        };
+        if (isa < Isa::Count)
+            return supported[static_cast<int>(isa)];
+#endif
+        return false;
+    }
+
+    const KernelSet& get(Isa isa)
+    {
+        for (const KernelSet& set : kKernelSets)
+        {
+            if (set.isa == isa && isSupported(isa))
+                return set;
+        }
+        return kKernelSets[0];
+    }
+
+    const KernelSet& best()
+    {
+        static const KernelSet& chosen = []() -> const KernelSet& {
+            for (int i = static_cast<int>(Isa::Count) - 1; i > 0; i--)
+            {
+                if (isSupported(static_cast<Isa>(i)))
+                    return get(static_cast<Isa>(i));
+            }
+            return kKernelSets[0];
+        }();
+        return chosen;
+    }
+}
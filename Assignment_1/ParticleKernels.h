@@ -0,0 +1,36 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <cstddef>
+
+// Per-particle kernels used by ParticleSys::update(). Every instruction set
+// implements the same operations on the structure-of-arrays state; the scalar
+// set is the reference the vector sets must match bit for bit.
+namespace ParticleKernels
+{
+    enum class Isa { Scalar, SSE2, AVX2, AVX512, Count };
+
+    // Entries in a colour-over-life table, indexed by normalized age.
+    const std::size_t kLutSize = 256;
+
+    struct KernelSet
+    {
+        Isa isa;
+        const char* name;
+
+        // pos += vel * dt
+        void (*integrate)(float* posX, float* posY, const float* velX, const float* velY, float dt, std::size_t n);
+        // velY += dv
+        void (*addGravity)(float* velY, float dv, std::size_t n);
+        // lifetime -= dt
+        void (*age)(float* lifetime, float dt, std::size_t n);
+        // Looks up each particle's colour in lut (kLutSize entries) at
+        // normalized age 1 - lifetime * invLife.
+        void (*shadeColors)(const float* lifetime, const float* invLife, const sf::Color* lut, sf::Color* out, std::size_t n);
+    };
+
+    bool isSupported(Isa isa);
+    const KernelSet& get(Isa isa);
+
+    // Widest instruction set the running CPU and OS support, chosen once.
+    const KernelSet& best();
+}
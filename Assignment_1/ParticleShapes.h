@@ -0,0 +1,194 @@
+#pragma once
+#include "FastMath.h"
+#include "ParticleKernels.h"
+#include <SFML/System/Vector2.hpp>
+#include <cmath>
+#include <cstddef>
+
+// Emitter shapes as compile-time policies. ParticleSys instantiates its spawn
+// and update loops once per policy, so nothing inside those loops branches on
+// the shape. This is for keeping each shape's rules in one place, not for
+// speed: every chunk already held a single shape, so the old per-particle
+// switch predicted well and timed the same within noise. A new shape is one
+// more policy here, its value in ParticleSys::ParticleShape and its entry in
+// the table in ParticleSys.cpp.
+//
+// Every policy provides:
+//   name()        shown in the UI and accepted by the benchmark
+//   kRadial       u0 is an angle in [0, 2pi) rather than a float in [0, 1)
+//   kThirdRandom  spawns also draw u2 in [0, 1)
+//   kGravity      velocities gain gravity every step
+//   spawn()       sets the position and motion of particle i
+//   setStep()     called before move() when the step length has changed
+//   move()        advances the first n particles by dt
+namespace ParticleShapes
+{
+    // Pointers to one chunk's particle arrays; index 0 is its first slot.
+    struct Arrays
+    {
+        float* posX;
+        float* posY;
+        float* velX;
+        float* velY;
+        float* dirX;
+        float* dirY;
+        float* radius;
+        float* angularSpeed;
+        float* stepCos;
+        float* stepSin;
+    };
+
+    // What a spawn needs to know besides its random numbers.
+    struct SpawnContext
+    {
+        sf::Vector2f position;
+        // Half the quad size.
+        float half;
+        // Length of the step being simulated.
+        float dt;
+    };
+
+    // Gravity in pixels per second squared.
+    const float kGravityAcceleration = 180.0f;
+
+    // Particles that move in a straight line at their velocity. Spawns place
+    // the quad's top-left corner on the emitter.
+    struct Linear
+    {
+        static const bool kRadial = false;
+        static const bool kThirdRandom = false;
+        static const bool kGravity = false;
+
+        static void place(const Arrays& a, std::size_t i, const SpawnContext& ctx, float vx, float vy)
+        {
+            a.posX[i] = ctx.position.x + ctx.half;
+            a.posY[i] = ctx.position.y + ctx.half;
+            a.velX[i] = vx;
+            a.velY[i] = vy;
+        }
+
+        static void setStep(const Arrays&, std::size_t, float)
+        {
+        }
+
+        static void move(const Arrays& a, std::size_t n, sf::Vector2f, float dt, const ParticleKernels::KernelSet& kernels)
+        {
+            kernels.integrate(a.posX, a.posY, a.velX, a.velY, dt, n);
+        }
+    };
+
+    struct Torch : Linear
+    {
+        static const char* name() { return "Torch"; }
+
+        static void spawn(const Arrays& a, std::size_t i, float u0, float u1, float, const SpawnContext& ctx)
+        {
+            place(a, i, ctx, (u0 - 0.5f) * 60.0f, -u1 * 120.0f - 60.0f);
+        }
+    };
+
+    struct Firework : Linear
+    {
+        static const bool kRadial = true;
+
+        static const char* name() { return "Firework"; }
+
+        static void spawn(const Arrays& a, std::size_t i, float u0, float u1, float, const SpawnContext& ctx)
+        {
+            const float radius = u1 * 300.0f;
+            float s, c;
+            FastMath::sincos(u0, s, c);
+            place(a, i, ctx, radius * c, radius * s);
+        }
+    };
+
+    struct Fountain : Linear
+    {
+        static const bool kGravity = true;
+
+        static const char* name() { return "Fountain"; }
+
+        static void spawn(const Arrays& a, std::size_t i, float u0, float u1, float, const SpawnContext& ctx)
+        {
+            place(a, i, ctx, (u0 - 0.5f) * 30.0f, -u1 * 180.0f);
+        }
+    };
+
+    // Particles orbit the emitter on a widening circle instead of using their
+    // velocity. Each keeps its unit direction from the emitter and turns it
+    // by a fixed rotation every step, so the update needs no trigonometry;
+    // the per-step rotations are only recomputed when the step length
+    // changes.
+    struct Spiral : Linear
+    {
+        static const bool kRadial = true;
+
+        static const char* name() { return "Spiral"; }
+
+        static void spawn(const Arrays& a, std::size_t i, float u0, float u1, float, const SpawnContext& ctx)
+        {
+            place(a, i, ctx, 0.0f, 0.0f);
+            FastMath::sincos(u0, a.dirY[i], a.dirX[i]);
+            a.radius[i] = 0.0f;
+            a.angularSpeed[i] = 6.0f + u1 * 12.0f;
+            FastMath::sincos(a.angularSpeed[i] * ctx.dt, a.stepSin[i], a.stepCos[i]);
+        }
+
+        static void setStep(const Arrays& a, std::size_t n, float dt)
+        {
+            for (std::size_t p = 0; p < n; p++)
+                FastMath::sincos(a.angularSpeed[p] * dt, a.stepSin[p], a.stepCos[p]);
+        }
+
+        static void move(const Arrays& a, std::size_t n, sf::Vector2f position, float dt, const ParticleKernels::KernelSet&)
+        {
+            for (std::size_t p = 0; p < n; p++)
+            {
+                const float x = a.dirX[p] * a.stepCos[p] - a.dirY[p] * a.stepSin[p];
+                const float y = a.dirX[p] * a.stepSin[p] + a.dirY[p] * a.stepCos[p];
+
+                // One Newton step towards unit length keeps rounding errors
+                // from building up over the particle's life.
+                const float k = 1.5f - 0.5f * (x * x + y * y);
+                a.dirX[p] = x * k;
+                a.dirY[p] = y * k;
+                a.radius[p] += 30.0f * dt;
+
+                a.posX[p] = position.x + a.dirX[p] * a.radius[p];
+                a.posY[p] = position.y + a.dirY[p] * a.radius[p];
+            }
+        }
+    };
+
+    struct Explosion : Linear
+    {
+        static const bool kRadial = true;
+
+        static const char* name() { return "Explosion"; }
+
+        static void spawn(const Arrays& a, std::size_t i, float u0, float u1, float, const SpawnContext& ctx)
+        {
+            const float power = 150.0f + u1 * 120.0f;
+            float s, c;
+            FastMath::sincos(u0, s, c);
+            place(a, i, ctx, power * c, power * s);
+        }
+    };
+
+    // Drops fall from the top edge anywhere left of the emitter.
+    struct Rain : Linear
+    {
+        static const bool kThirdRandom = true;
+        static const bool kGravity = true;
+
+        static const char* name() { return "Rain"; }
+
+        static void spawn(const Arrays& a, std::size_t i, float u0, float u1, float u2, const SpawnContext& ctx)
+        {
+            a.posX[i] = std::floor(u2 * ctx.position.x);
+            a.posY[i] = 0.0f;
+            a.velX[i] = (u0 - 0.5f) * 12.0f;
+            a.velY[i] = 60.0f + u1 * 60.0f;
+        }
+    };
+}
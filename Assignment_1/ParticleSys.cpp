@@ -0,0 +1,549 @@
+﻿#include "ParticleSys.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+// Out-of-class definitions, needed wherever the constants are bound to a
+// reference such as std::min()'s arguments.
+const size_t ParticleSys::kChunkSize;
+const uint32_t ParticleSys::kNone;
+
+ParticleSys::ParticleSys()
+{
+    // Emitter and chunk slots are recycled, so after these reservations
+    // starting and finishing emitters does not allocate until the pool has
+    // to grow.
+    m_emitters.reserve(256);
+    m_freeChunks.reserve(256);
+    resizeScratch();
+}
+
+void ParticleSys::init(sf::Vector2u position)
+{
+    for (uint32_t e = 0; e < m_emitters.size(); e++)
+    {
+        if (m_emitters[e].active)
+            releaseEmitter(e);
+    }
+    m_selected = startEmitter(sf::Vector2f(position), 0.0f);
+}
+
+void ParticleSys::addEmitter(sf::Vector2f position)
+{
+    m_selected = startEmitter(position, m_params.emitter.emitterLife);
+}
+
+void ParticleSys::setParams(const Params& params)
+{
+    const Params old = m_params;
+    m_params = params;
+
+    if (params.threads != old.threads)
+    {
+        m_pool.setThreadCount(params.threads);
+        m_params.threads = m_pool.getThreadCount();
+        resizeScratch();
+    }
+    if (params.kernels != old.kernels)
+    {
+        m_kernels = &ParticleKernels::get(params.kernels);
+        m_params.kernels = m_kernels->isa;
+    }
+
+    // The size needs no work: quads are rebuilt from the particle centres
+    // every frame. Emitter settings also go to the newest running emitter.
+    if (m_selected == kNone)
+        return;
+
+    Emitter& selected = m_emitters[m_selected];
+    const EmitterSettings& settings = params.emitter;
+    if (settings.count != old.emitter.count)
+    {
+        selected.settings.count = settings.count;
+        setEmitterCount(m_selected, static_cast<size_t>(settings.count));
+    }
+    if (settings.particleLife != old.emitter.particleLife)
+    {
+        selected.settings.particleLife = settings.particleLife;
+    }
+    // The shading pass reads the baked table every frame, so a new gradient
+    // shows at once. A new shape gets fresh chunks; the old ones keep moving
+    // their particles as before until they have died out.
+    if (settings.gradient != selected.settings.gradient)
+    {
+        selected.settings.gradient = settings.gradient;
+        selected.settings.gradient.bake(selected.lut, ParticleKernels::kLutSize);
+    }
+    if (settings.shape != selected.settings.shape)
+    {
+        selected.settings.shape = settings.shape;
+        retireChunks(m_selected);
+        setEmitterCount(m_selected, static_cast<size_t>(selected.settings.count));
+    }
+}
+
+size_t ParticleSys::getEmitterCount() const
+{
+    size_t count = 0;
+    for (const Emitter& emitter : m_emitters)
+    {
+        if (emitter.active)
+            count++;
+    }
+    return count;
+}
+
+uint32_t ParticleSys::startEmitter(sf::Vector2f position, float emitterLife)
+{
+    uint32_t index = 0;
+    while (index < m_emitters.size() && m_emitters[index].active)
+        index++;
+    if (index == m_emitters.size())
+        m_emitters.emplace_back();
+
+    Emitter& emitter = m_emitters[index];
+    emitter.settings = m_params.emitter;
+    emitter.settings.emitterLife = emitterLife;
+    emitter.position = position;
+    emitter.remaining = emitterLife > 0.0f ? emitterLife : -1.0f;
+    emitter.serial = m_nextSerial++;
+    emitter.firstChunk = kNone;
+    emitter.active = true;
+    emitter.settings.gradient.bake(emitter.lut, ParticleKernels::kLutSize);
+
+    setEmitterCount(index, static_cast<size_t>(emitter.settings.count));
+    return index;
+}
+
+void ParticleSys::releaseEmitter(uint32_t emitter)
+{
+    Emitter& e = m_emitters[emitter];
+    uint32_t chunk = e.firstChunk;
+    while (chunk != kNone)
+    {
+        uint32_t next = m_chunks[chunk].next;
+        releaseChunk(chunk);
+        chunk = next;
+    }
+    e.firstChunk = kNone;
+    e.active = false;
+    dropDrainingChunks(emitter);
+
+    if (m_selected == emitter)
+        m_selected = kNone;
+}
+
+void ParticleSys::retireChunks(uint32_t emitter)
+{
+    Emitter& e = m_emitters[emitter];
+    uint32_t chunk = e.firstChunk;
+    while (chunk != kNone)
+    {
+        Chunk& c = m_chunks[chunk];
+        uint32_t next = c.next;
+        if (c.alive == 0)
+        {
+            releaseChunk(chunk);
+        }
+        else
+        {
+            c.next = kNone;
+            c.draining = true;
+            e.drainingChunks++;
+        }
+        chunk = next;
+    }
+    e.firstChunk = kNone;
+}
+
+void ParticleSys::dropDrainingChunks(uint32_t emitter)
+{
+    Emitter& e = m_emitters[emitter];
+    for (uint32_t c = 0; c < m_chunks.size() && e.drainingChunks > 0; c++)
+    {
+        if (m_chunks[c].draining && m_chunks[c].emitter == emitter)
+        {
+            releaseChunk(c);
+            e.drainingChunks--;
+        }
+    }
+}
+
+void ParticleSys::releaseDrainedChunks()
+{
+    for (uint32_t c = 0; c < m_chunks.size(); c++)
+    {
+        Chunk& chunk = m_chunks[c];
+        if (chunk.draining && chunk.alive == 0)
+        {
+            m_emitters[chunk.emitter].drainingChunks--;
+            releaseChunk(c);
+        }
+    }
+}
+
+void ParticleSys::resetEmitter(uint32_t emitter)
+{
+    dropDrainingChunks(emitter);
+
+    const Emitter& e = m_emitters[emitter];
+    uint32_t ordinal = 0;
+    for (uint32_t chunk = e.firstChunk; chunk != kNone; chunk = m_chunks[chunk].next)
+    {
+        m_chunks[chunk].alive = 0;
+        m_chunks[chunk].shape = e.settings.shape;
+        seedChunk(chunk, e, ordinal++);
+    }
+}
+
+void ParticleSys::resetParticles()
+{
+    for (uint32_t e = 0; e < m_emitters.size(); e++)
+    {
+        if (m_emitters[e].active)
+            resetEmitter(e);
+    }
+}
+
+void ParticleSys::seedChunk(uint32_t chunk, const Emitter& emitter, uint32_t ordinal)
+{
+    // Streams depend on the emitter and the chunk's place in its list, not on
+    // which pool chunk it was given, so replays do not depend on recycling.
+    m_chunkRng[chunk].seed(m_seed ^ (static_cast<uint64_t>(emitter.serial) << 32), ordinal);
+}
+
+uint32_t ParticleSys::acquireChunk()
+{
+    if (!m_freeChunks.empty())
+    {
+        uint32_t chunk = m_freeChunks.back();
+        m_freeChunks.pop_back();
+        return chunk;
+    }
+
+    // Storage grows geometrically and never shrinks, so the pool stops
+    // allocating once it has reached its largest size.
+    uint32_t chunk = static_cast<uint32_t>(m_chunks.size());
+    m_chunks.emplace_back();
+    m_chunkRng.emplace_back();
+
+    const size_t capacity = m_chunks.size() * kChunkSize;
+    m_posX.resize(capacity);
+    m_posY.resize(capacity);
+    m_velX.resize(capacity);
+    m_velY.resize(capacity);
+    m_lifetime.resize(capacity);
+    m_invLife.resize(capacity);
+    m_prevX.resize(capacity);
+    m_prevY.resize(capacity);
+    m_dirX.resize(capacity);
+    m_dirY.resize(capacity);
+    m_radius.resize(capacity);
+    m_angularSpeed.resize(capacity);
+    m_stepCos.resize(capacity);
+    m_stepSin.resize(capacity);
+    m_colors.resize(capacity);
+    m_vertices.resize(capacity * 4);
+    return chunk;
+}
+
+void ParticleSys::releaseChunk(uint32_t chunk)
+{
+    m_chunks[chunk] = Chunk();
+    m_freeChunks.push_back(chunk);
+}
+
+void ParticleSys::setEmitterCount(uint32_t emitter, size_t count)
+{
+    Emitter& e = m_emitters[emitter];
+    size_t remaining = count;
+    uint32_t ordinal = 0;
+    uint32_t last = kNone;
+
+    // Live particles are packed at the front of each chunk, so shrinking
+    // drops the trailing ones and keeps the rest as they are.
+    uint32_t chunk = e.firstChunk;
+    while (chunk != kNone)
+    {
+        uint32_t next = m_chunks[chunk].next;
+        if (remaining == 0)
+        {
+            releaseChunk(chunk);
+        }
+        else
+        {
+            Chunk& c = m_chunks[chunk];
+            c.slots = static_cast<uint32_t>(std::min(kChunkSize, remaining));
+            c.alive = std::min(c.alive, c.slots);
+            remaining -= c.slots;
+            last = chunk;
+            ordinal++;
+        }
+        chunk = next;
+    }
+
+    if (last == kNone)
+        e.firstChunk = kNone;
+    else
+        m_chunks[last].next = kNone;
+
+    // Added slots start dead and are filled on the next update.
+    while (remaining > 0)
+    {
+        chunk = acquireChunk();
+        Chunk& c = m_chunks[chunk];
+        c.emitter = emitter;
+        c.next = kNone;
+        c.slots = static_cast<uint32_t>(std::min(kChunkSize, remaining));
+        c.alive = 0;
+        c.shape = e.settings.shape;
+        seedChunk(chunk, e, ordinal++);
+
+        if (last == kNone)
+            e.firstChunk = chunk;
+        else
+            m_chunks[last].next = chunk;
+        last = chunk;
+        remaining -= c.slots;
+    }
+}
+
+void ParticleSys::resizeScratch()
+{
+    m_scratch.resize(m_pool.getThreadCount());
+    m_updateTimes.assign(m_pool.getThreadCount(), 0.0);
+    m_frameUpdateTimes.assign(m_pool.getThreadCount(), 0.0);
+    for (SpawnScratch& scratch : m_scratch)
+    {
+        scratch.u0.resize(kChunkSize);
+        scratch.u1.resize(kChunkSize);
+        scratch.u2.resize(kChunkSize);
+        scratch.life.resize(kChunkSize);
+    }
+}
+
+void ParticleSys::moveParticle(size_t from, size_t to)
+{
+    m_posX[to] = m_posX[from];
+    m_posY[to] = m_posY[from];
+    m_velX[to] = m_velX[from];
+    m_velY[to] = m_velY[from];
+    m_lifetime[to] = m_lifetime[from];
+    m_invLife[to] = m_invLife[from];
+    m_prevX[to] = m_prevX[from];
+    m_prevY[to] = m_prevY[from];
+    m_dirX[to] = m_dirX[from];
+    m_dirY[to] = m_dirY[from];
+    m_radius[to] = m_radius[from];
+    m_angularSpeed[to] = m_angularSpeed[from];
+    m_stepCos[to] = m_stepCos[from];
+    m_stepSin[to] = m_stepSin[from];
+}
+
+size_t ParticleSys::compact(size_t begin, size_t count)
+{
+    // Swap-remove: an expired particle is overwritten by the last live one,
+    // which keeps the live range packed without shifting the whole chunk.
+    size_t p = begin;
+    size_t end = begin + count;
+    while (p < end)
+    {
+        if (m_lifetime[p] <= 0.0f)
+        {
+            end--;
+            if (p != end)
+                moveParticle(end, p);
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return end - begin;
+}
+
+template <class Shape>
+void ParticleSys::spawnParticles(const Emitter& emitter, size_t begin, size_t count, float dt, Random& rng, SpawnScratch& scratch)
+{
+    if (count == 0)
+        return;
+
+    if (Shape::kRadial)
+        rng.fillAngles(scratch.u0.data(), count);
+    else
+        rng.fillFloats(scratch.u0.data(), count);
+    rng.fillFloats(scratch.u1.data(), count);
+    if (Shape::kThirdRandom)
+        rng.fillFloats(scratch.u2.data(), count);
+    rng.fillFloats(scratch.life.data(), count, 0.5f, 0.5f + emitter.settings.particleLife);
+
+    const ParticleShapes::Arrays arrays = chunkArrays(begin);
+    ParticleShapes::SpawnContext ctx;
+    ctx.position = emitter.position;
+    ctx.half = m_params.size / 2.0f;
+    ctx.dt = dt;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t index = begin + i;
+        Shape::spawn(arrays, i, scratch.u0[i], scratch.u1[i], scratch.u2[i], ctx);
+
+        m_prevX[index] = m_posX[index];
+        m_prevY[index] = m_posY[index];
+        m_lifetime[index] = scratch.life[i];
+        m_invLife[index] = 1.0f / scratch.life[i];
+    }
+}
+
+void ParticleSys::update(float dt)
+{
+    PROFILE_ZONE("Particles/Update");
+    auto job = [this, dt](size_t chunk, unsigned thread) {
+        const Chunk& c = m_chunks[chunk];
+        if (c.emitter != kNone)
+            (this->*kShapes[static_cast<int>(c.shape)].simulate)(chunk, thread, dt);
+    };
+    m_pool.run(m_chunks.size(), job);
+    const std::vector<double>& times = m_pool.getThreadTimes();
+    for (size_t t = 0; t < times.size(); t++)
+        m_updateTimes[t] += times[t];
+    releaseDrainedChunks();
+
+    // Finished emitters are recycled once their last particle has died.
+    for (uint32_t e = 0; e < m_emitters.size(); e++)
+    {
+        Emitter& emitter = m_emitters[e];
+        if (!emitter.active)
+            continue;
+
+        if (emitter.remaining > 0.0f)
+            emitter.remaining = std::max(0.0f, emitter.remaining - dt);
+        if (emitter.remaining != 0.0f)
+            continue;
+
+        bool empty = emitter.drainingChunks == 0;
+        for (uint32_t chunk = emitter.firstChunk; chunk != kNone; chunk = m_chunks[chunk].next)
+            empty = empty && m_chunks[chunk].alive == 0;
+        if (empty)
+            releaseEmitter(e);
+    }
+}
+
+template <class Shape>
+void ParticleSys::simulateChunk(size_t chunk, unsigned thread, float dt)
+{
+    Chunk& c = m_chunks[chunk];
+    const Emitter& emitter = m_emitters[c.emitter];
+    const size_t begin = chunk * kChunkSize;
+    const size_t n = c.alive;
+
+    std::copy(m_posX.begin() + begin, m_posX.begin() + begin + n, m_prevX.begin() + begin);
+    std::copy(m_posY.begin() + begin, m_posY.begin() + begin + n, m_prevY.begin() + begin);
+
+    const ParticleShapes::Arrays arrays = chunkArrays(begin);
+    if (dt != c.step)
+    {
+        Shape::setStep(arrays, n, dt);
+        c.step = dt;
+    }
+    Shape::move(arrays, n, emitter.position, dt, *m_kernels);
+    if (Shape::kGravity)
+        m_kernels->addGravity(&m_velY[begin], ParticleShapes::kGravityAcceleration * dt, n);
+
+    m_kernels->age(&m_lifetime[begin], dt, n);
+
+    // Expired particles are removed before they are drawn; while the emitter
+    // is still running the freed slots are refilled.
+    const size_t alive = compact(begin, n);
+    const size_t spawn = emitter.remaining != 0.0f && !c.draining ? c.slots - alive : 0;
+    spawnParticles<Shape>(emitter, begin + alive, spawn, dt, m_chunkRng[chunk], m_scratch[thread]);
+    c.alive = static_cast<uint32_t>(alive + spawn);
+}
+
+ParticleShapes::Arrays ParticleSys::chunkArrays(size_t begin)
+{
+    ParticleShapes::Arrays arrays;
+    arrays.posX = &m_posX[begin];
+    arrays.posY = &m_posY[begin];
+    arrays.velX = &m_velX[begin];
+    arrays.velY = &m_velY[begin];
+    arrays.dirX = &m_dirX[begin];
+    arrays.dirY = &m_dirY[begin];
+    arrays.radius = &m_radius[begin];
+    arrays.angularSpeed = &m_angularSpeed[begin];
+    arrays.stepCos = &m_stepCos[begin];
+    arrays.stepSin = &m_stepSin[begin];
+    return arrays;
+}
+
+// In ParticleShape order.
+const ParticleSys::ShapeEntry ParticleSys::kShapes[] = {
+    { &ParticleSys::simulateChunk<ParticleShapes::Torch>, ParticleShapes::Torch::name },
+    { &ParticleSys::simulateChunk<ParticleShapes::Firework>, ParticleShapes::Firework::name },
+    { &ParticleSys::simulateChunk<ParticleShapes::Fountain>, ParticleShapes::Fountain::name },
+    { &ParticleSys::simulateChunk<ParticleShapes::Spiral>, ParticleShapes::Spiral::name },
+    { &ParticleSys::simulateChunk<ParticleShapes::Explosion>, ParticleShapes::Explosion::name },
+    { &ParticleSys::simulateChunk<ParticleShapes::Rain>, ParticleShapes::Rain::name },
+};
+
+const char* ParticleSys::shapeName(ParticleShape shape)
+{
+    static_assert(sizeof(kShapes) / sizeof(kShapes[0]) == static_cast<size_t>(ParticleShape::Count),
+        "every ParticleShape needs an entry in kShapes");
+
+    const int index = static_cast<int>(shape);
+    return index >= 0 && shape < ParticleShape::Count ? kShapes[index].name() : "";
+}
+
+void ParticleSys::buildVertices(float alpha)
+{
+    PROFILE_ZONE("Particles/Vertices");
+    // Live ranges are packed per chunk; a prefix sum over the chunk counts
+    // places them back to back so draw() covers live particles only.
+    size_t offset = 0;
+    for (Chunk& c : m_chunks)
+    {
+        c.offset = offset;
+        offset += c.alive;
+    }
+    m_aliveCount = offset;
+
+    // A displayed frame ends here: its update passes are done.
+    m_frameUpdateTimes.swap(m_updateTimes);
+    std::fill(m_updateTimes.begin(), m_updateTimes.end(), 0.0);
+
+    auto job = [this, alpha](size_t chunk, unsigned) {
+        const Chunk& c = m_chunks[chunk];
+        if (c.alive == 0)
+            return;
+
+        const size_t begin = chunk * kChunkSize;
+        const sf::Color* lut = m_emitters[c.emitter].lut;
+        m_kernels->shadeColors(&m_lifetime[begin], &m_invLife[begin], lut, &m_colors[begin], c.alive);
+        writeVertices(begin, begin + c.alive, c.offset, alpha);
+    };
+    m_pool.run(m_chunks.size(), job);
+}
+
+void ParticleSys::writeVertices(size_t begin, size_t end, size_t offset, float alpha)
+{
+    const float half = m_params.size / 2.0f;
+    sf::Vertex* v = m_vertices.data() + 4 * offset;
+
+    for (size_t p = begin; p < end; p++, v += 4)
+    {
+        const float x = m_prevX[p] + (m_posX[p] - m_prevX[p]) * alpha;
+        const float y = m_prevY[p] + (m_posY[p] - m_prevY[p]) * alpha;
+        const sf::Color c = m_colors[p];
+
+        v[0].position = sf::Vector2f(x - half, y - half);
+        v[1].position = sf::Vector2f(x + half, y - half);
+        v[2].position = sf::Vector2f(x + half, y + half);
+        v[3].position = sf::Vector2f(x - half, y + half);
+
+        v[0].color = c;
+        v[1].color = c;
+        v[2].color = c;
+        v[3].color = c;
+    }
+}
@@ -1,239 +1,219 @@
 ﻿#pragma once
 #include "SFML/Graphics.hpp"
+#include "ColorGradient.h"
+#include "ParticleKernels.h"
+#include "ParticleShapes.h"
+#include "Random.h"
+#include "WorkerPool.h"
+#include <cstdint>
 #include <vector>
-#include <imgui.h>
 
+// Particle pool shared by any number of emitters. Every emitter owns a list
+// of fixed-size chunks of the pool; all chunks are simulated in one parallel
+// pass and all live particles are drawn with a single draw call.
 class ParticleSys
 {
 public:
-    enum class ParticleShape { Torch, Firework, Fountain, Spiral, Explosion, Rain };
+    // One value per policy in ParticleShapes.h, in the same order.
+    enum class ParticleShape { Torch, Firework, Fountain, Spiral, Explosion, Rain, Count };
 
-private:
-    struct Particle
+    struct EmitterSettings
     {
-        sf::Vector2f velocity;
-        int lifetime = 0;
+        ParticleShape shape = ParticleShape::Torch;
+        // Step length the shape last prepared its particles for.
+        float step = 0.0f;
+        // Colour and alpha over each particle's life.
+        ColorGradient gradient = ColorGradient::preset(ColorGradient::Preset::Fire);
+        float count = 1000;
+        // Seconds a particle may live on top of the 0.5 s minimum.
+        float particleLife = 1.0f;
+        // Seconds the emitter keeps spawning; 0 means forever.
+        float emitterLife = 2.0f;
+    };
 
-        float angle = 0.f;
-        float radius = 0.f;
-        float angularSpeed = 0.f;
+    // Everything the user can tune. The simulation only reads its own copy;
+    // edits are handed over with setParams() between updates.
+    struct Params
+    {
+        // Settings for new emitters; count, life, shape and gradient also
+        // apply to the newest running emitter. Gradient changes show at once,
+        // a new shape or life only for particles spawned after the change.
+        EmitterSettings emitter;
+        float size = 8;
+        ParticleKernels::Isa kernels = ParticleKernels::best().isa;
+        unsigned threads = WorkerPool::hardwareThreads();
     };
 
-    std::vector<Particle> m_particles;
-    sf::VertexArray m_vertices;
-    sf::Vector2u m_position;
-    float m_size = 8;
-    float m_count = 1000;
-    float m_time = 60;
-    ParticleShape m_shape = ParticleShape::Torch;
-    sf::Color baseColor = sf::Color(255, 100, 30, 255);
+private:
+    // Particles are updated in fixed-size chunks, each with its own random
+    // stream, so the result does not depend on how many threads run them.
+    // Within a chunk the live particles are kept packed at the front.
+    static const size_t kChunkSize = 1024;
+    static const uint32_t kNone = 0xFFFFFFFFu;
 
-    void resetParticles(size_t count = 1000, float size = 8)
+    struct Chunk
     {
-        m_particles = std::vector<Particle>(m_count);
-        m_vertices = sf::VertexArray(sf::Quads, m_count * 4);
-        m_size = size;
-
-        for (size_t p = 0; p < m_particles.size(); p++)
-        {
-            resetParticle(p, true);
-        }
-    }
+        uint32_t emitter = kNone;
+        uint32_t next = kNone;
+        uint32_t slots = 0;
+        uint32_t alive = 0;
+        size_t offset = 0;
+        // How the particles in this chunk move; fixed while it is in use.
+        ParticleShape shape = ParticleShape::Torch;
+        // Step length the shape last prepared its particles for.
+        float step = 0.0f;
+        // Retired chunks no longer belong to the emitter's list: they stop
+        // spawning and are freed once their last particle has died.
+        bool draining = false;
+    };
 
-    void resetParticle(std::size_t index, bool first = false)
+    struct Emitter
     {
-        sf::Vector2f center;
-
-        float half = m_size / 2.0f;
-
-        switch (m_shape)
-        {
-        case ParticleShape::Rain:
-            center = sf::Vector2f(rand() % m_position.x, 0);
-            m_vertices[4 * index + 0].position = center + sf::Vector2f(-half, -half);
-            m_vertices[4 * index + 1].position = center + sf::Vector2f(half, -half);
-            m_vertices[4 * index + 2].position = center + sf::Vector2f(half, half);
-            m_vertices[4 * index + 3].position = center + sf::Vector2f(-half, half);
-            break;
-        case ParticleShape::Explosion:
-        case ParticleShape::Spiral:
-        case ParticleShape::Firework:
-            m_vertices[4 * index + 0].position = sf::Vector2f(m_position.x, m_position.y);
-            m_vertices[4 * index + 1].position = sf::Vector2f(m_position.x + m_size, m_position.y);
-            m_vertices[4 * index + 2].position = sf::Vector2f(m_position.x + m_size, m_position.y + m_size);
-            m_vertices[4 * index + 3].position = sf::Vector2f(m_position.x, m_position.y + m_size);
-
-            break;
-        case ParticleShape::Torch:
-        case ParticleShape::Fountain:
-        default:
-            m_vertices[4 * index + 0].position = sf::Vector2f(m_position.x, m_position.y);
-            m_vertices[4 * index + 1].position = sf::Vector2f(m_position.x + m_size, m_position.y);
-            m_vertices[4 * index + 2].position = sf::Vector2f(m_position.x + m_size, m_position.y + m_size);
-            m_vertices[4 * index + 3].position = sf::Vector2f(m_position.x, m_position.y + m_size);
-            break;
-        }
-
-        sf::Color c = baseColor;
-        if (first)
-        {
-            c = sf::Color(0, 0, 0, 0);
-            m_particles[index].lifetime = 0;
-            return;
-        }
-
-        for (int i = 0; i < 4; ++i)
-            m_vertices[4 * index + i].color = c;
-
-        switch (m_shape)
-        {
-        case ParticleShape::Torch: {
-            float vx = ((float)rand() / RAND_MAX - 0.5f) * 1.0f;
-            float vy = -((float)rand() / RAND_MAX) * 2.0f - 1.0f;
-            m_particles[index].velocity = sf::Vector2f(vx, vy);
-            break;
-        }
-        case ParticleShape::Firework: {
-            float theta = ((float)rand() / RAND_MAX) * 2 * 3.14159f;
-            float radius = ((float)rand() / RAND_MAX) * 5;
-            float rx = radius * cos(theta);
-            float ry = radius * sin(theta);
-            m_particles[index].velocity = sf::Vector2f(rx, ry);
-            break;
-        }
-        case ParticleShape::Fountain: {
-            float vx = ((float)rand() / RAND_MAX - 0.5f) * 0.5f;
-            float vy = -((float)rand() / RAND_MAX) * 3.0f;
-            m_particles[index].velocity = sf::Vector2f(vx, vy);
-            break;
-        }
-        case ParticleShape::Spiral: {
-            m_particles[index].angle = ((float)rand() / RAND_MAX) * 2 * 3.14159f;
-            m_particles[index].radius = 0.0f;
-            m_particles[index].angularSpeed = 0.1f + ((float)rand() / RAND_MAX) * 0.2f;
-            m_particles[index].velocity = sf::Vector2f(0, 0);
-            break;
-        }
-        case ParticleShape::Explosion: {
-            float theta = ((float)rand() / RAND_MAX) * 2 * 3.14159f;
-            float power = 2.5f + ((float)rand() / RAND_MAX) * 2.0f;
-            float vx = power * cos(theta);
-            float vy = power * sin(theta);
-            m_particles[index].velocity = sf::Vector2f(vx, vy);
-            break;
-        }
-        case ParticleShape::Rain: {
-            float vx = ((float)rand() / RAND_MAX - 0.5f) * 0.2f;
-            float vy = 1.0f + ((float)rand() / RAND_MAX) * 1.0f;
-            m_particles[index].velocity = sf::Vector2f(vx, vy);
-            break;
-        }
-        }
-
-        m_particles[index].lifetime = 30 + rand() % int(m_time);
-    }
+        EmitterSettings settings;
+        sf::Vector2f position;
+        // Seconds of spawning left; negative for an endless emitter.
+        float remaining = -1.0f;
+        uint32_t serial = 0;
+        uint32_t firstChunk = kNone;
+        uint32_t drainingChunks = 0;
+        bool active = false;
+        // settings.gradient baked into a table, so shading a particle is one
+        // lookup by its normalized age.
+        sf::Color lut[ParticleKernels::kLutSize];
+    };
+
+    // Per-thread buffers for batched spawns: the random numbers for all
+    // particles spawned in a chunk are generated in one go.
+    struct SpawnScratch
+    {
+        std::vector<float> u0;
+        std::vector<float> u1;
+        std::vector<float> u2;
+        std::vector<float> life;
+    };
+
+    // Particle state is stored as a structure of arrays: update() streams only
+    // the fields it touches and the quads are generated from them in one pass.
+    // Velocities are in pixels per second and lifetimes in seconds.
+    std::vector<float> m_posX;
+    std::vector<float> m_posY;
+    std::vector<float> m_velX;
+    std::vector<float> m_velY;
+    std::vector<float> m_lifetime;
+    // 1 / lifetime at spawn, to turn the remaining lifetime into an age.
+    std::vector<float> m_invLife;
+
+    // Positions before the last step, blended with the current ones when
+    // drawing between two steps.
+    std::vector<float> m_prevX;
+    std::vector<float> m_prevY;
+
+    // Orbit state of Spiral particles; see ParticleShapes::Spiral.
+    std::vector<float> m_dirX;
+    std::vector<float> m_dirY;
+    std::vector<float> m_radius;
+    std::vector<float> m_angularSpeed;
+    std::vector<float> m_stepCos;
+    std::vector<float> m_stepSin;
+
+    std::vector<sf::Color> m_colors;
+    const ParticleKernels::KernelSet* m_kernels = &ParticleKernels::best();
+
+    std::vector<Chunk> m_chunks;
+    std::vector<Random> m_chunkRng;
+    std::vector<uint32_t> m_freeChunks;
+    std::vector<Emitter> m_emitters;
+    uint32_t m_selected = kNone;
+    uint32_t m_nextSerial = 0;
+    size_t m_aliveCount = 0;
+
+    std::vector<SpawnScratch> m_scratch;
+    uint64_t m_seed = 1;
+    WorkerPool m_pool{ WorkerPool::hardwareThreads() };
+    // Milliseconds per thread in the update passes since the last
+    // buildVertices(), and in those of the last displayed frame.
+    std::vector<double> m_updateTimes;
+    std::vector<double> m_frameUpdateTimes;
+
+    std::vector<sf::Vertex> m_vertices;
+    Params m_params;
+
+    uint32_t acquireChunk();
+    void releaseChunk(uint32_t chunk);
+    void seedChunk(uint32_t chunk, const Emitter& emitter, uint32_t ordinal);
+    void setEmitterCount(uint32_t emitter, size_t count);
+    void resetEmitter(uint32_t emitter);
+    void releaseEmitter(uint32_t emitter);
+    void retireChunks(uint32_t emitter);
+    void dropDrainingChunks(uint32_t emitter);
+    void releaseDrainedChunks();
+    uint32_t startEmitter(sf::Vector2f position, float emitterLife);
+    void resetParticles();
+    void resizeScratch();
+    void moveParticle(size_t from, size_t to);
+    size_t compact(size_t begin, size_t count);
+    ParticleShapes::Arrays chunkArrays(size_t begin);
+    template <class Shape>
+    void spawnParticles(const Emitter& emitter, size_t begin, size_t count, float dt, Random& rng, SpawnScratch& scratch);
+    template <class Shape>
+    void simulateChunk(size_t chunk, unsigned thread, float dt);
+    void writeVertices(size_t begin, size_t end, size_t offset, float alpha);
+
+    // Update loop and name of every shape, indexed by ParticleShape.
+    struct ShapeEntry
+    {
+        void (ParticleSys::*simulate)(size_t chunk, unsigned thread, float dt);
+        const char* (*name)();
+    };
+    static const ShapeEntry kShapes[];
 
 public:
-    ParticleSys() = default;
+    ParticleSys();
+
+    static const char* shapeName(ParticleShape shape);
+
+    // Removes every emitter and starts one endless emitter at position.
+    void init(sf::Vector2u position);
+
+    // Starts a new emitter with the current settings. Emitters started this
+    // way stop spawning after the configured emitter life and are recycled
+    // once their last particle has died.
+    void addEmitter(sf::Vector2f position);
+
+    const Params& getParams() const { return m_params; }
+
+    // Applies the parameters that differ from the current ones. Must not be
+    // called while update() runs.
+    void setParams(const Params& params);
 
-    void init(sf::Vector2u windowSize)
+    // Restarts all emitters with the given seed; the same seed and settings
+    // replay the same particles.
+    void setSeed(uint64_t seed)
     {
-        m_position = windowSize;
+        m_seed = seed;
         resetParticles();
     }
 
-    void update()
-    {
-        renderGUI();
-
-        for (size_t p = 0; p < m_particles.size(); p++)
-        {
-            if (m_particles[p].lifetime <= 0)
-            {
-                resetParticle(p);
-            }
-            else
-            {
-                float ratio = static_cast<float>(m_particles[p].lifetime) / 90.0f;
-
-                sf::Color c;
-                c.r = baseColor.r;
-                c.g = static_cast<sf::Uint8>(baseColor.g * ratio);
-                c.b = static_cast<sf::Uint8>(baseColor.b * ratio);
-                c.a = static_cast<sf::Uint8>(baseColor.a * ratio);
-
-                if (m_shape == ParticleShape::Spiral) {
-                    m_particles[p].angle += m_particles[p].angularSpeed;
-                    m_particles[p].radius += 0.5f;
-
-                    float x = m_position.x / 2 + cos(m_particles[p].angle) * m_particles[p].radius;
-                    float y = m_position.y / 2 + sin(m_particles[p].angle) * m_particles[p].radius;
-
-                    sf::Vector2f pos(x, y);
-                    float half = m_size / 2.0f;
-
-                    m_vertices[4 * p + 0].position = pos + sf::Vector2f(-half, -half);
-                    m_vertices[4 * p + 1].position = pos + sf::Vector2f(half, -half);
-                    m_vertices[4 * p + 2].position = pos + sf::Vector2f(half, half);
-                    m_vertices[4 * p + 3].position = pos + sf::Vector2f(-half, half);
-                }
-                else {
-                    for (int i = 0; i < 4; ++i)
-                        m_vertices[4 * p + i].position += m_particles[p].velocity;
-                }
-
-                for (int i = 0; i < 4; ++i)
-                    m_vertices[4 * p + i].color = c;
-
-                if (m_shape == ParticleShape::Fountain || m_shape == ParticleShape::Rain)
-                    m_particles[p].velocity.y += 0.05f;
-
-                m_particles[p].lifetime--;
-            }
-        }
-    }
+    // Advances every emitter by dt seconds.
+    void update(float dt);
 
-    void draw(sf::RenderWindow& window) const
-    {
-        window.draw(m_vertices);
-    }
+    // Shades all live particles and builds their quads alpha of the way from
+    // the previous step to the current one.
+    void buildVertices(float alpha);
 
-    void renderGUI()
+    // Builds the quads and draws them, once per displayed frame.
+    void draw(sf::RenderWindow& window, float alpha)
     {
-        ImGui::Begin("Particles");
-
-        if (ImGui::SliderFloat("Size", &m_size, 1.0f, 10.0f))
-        {
-            resetParticles(m_count, m_size);
-        }
-        if (ImGui::SliderFloat("Quantity", &m_count, 100.0f, 100000.0f))
-        {
-            resetParticles(m_count, m_size);
-        }
-        if (ImGui::SliderFloat("Time", &m_time, 30.0f, 150.0f))
-        {
-        }
-        static const char* shapeItems[] = {
-            "Torch", "Firework", "Fountain", "Spiral", "Explosion", "Rain"
-        };
-        static int currentShape = 0;
-
-        if (ImGui::Combo("Shape", &currentShape, shapeItems, IM_ARRAYSIZE(shapeItems)))
-        {
-            m_shape = static_cast<ParticleShape>(currentShape);
-            resetParticles(m_particles.size(), m_size);
-        }
-
-        float color[3] = { baseColor.r / 255.0f, baseColor.g / 255.0f, baseColor.b / 255.0f };
-        if (ImGui::ColorEdit3("Base Color", color))
-        {
-            baseColor.r = static_cast<sf::Uint8>(color[0] * 255);
-            baseColor.g = static_cast<sf::Uint8>(color[1] * 255);
-            baseColor.b = static_cast<sf::Uint8>(color[2] * 255);
-            baseColor.a = 255;
-            resetParticles(m_particles.size(), m_size);
-        }
-
-        ImGui::End();
+        buildVertices(alpha);
+        if (m_aliveCount > 0)
+            window.draw(m_vertices.data(), m_aliveCount * 4, sf::Quads);
     }
+
+    size_t getAliveCount() const { return m_aliveCount; }
+    size_t getCapacity() const { return m_chunks.size() * kChunkSize; }
+    size_t getEmitterCount() const;
+
+    // Milliseconds each worker thread spent simulating particles during the
+    // last displayed frame, summed over its update() calls.
+    const std::vector<double>& getThreadTimes() const { return m_frameUpdateTimes; }
 };
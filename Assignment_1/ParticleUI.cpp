@@ -0,0 +1,186 @@
+#include "ParticleUI.h"
+#include <imgui.h>
+
+namespace
+{
+    ImU32 toImU32(sf::Color c)
+    {
+        return IM_COL32(c.r, c.g, c.b, c.a);
+    }
+
+    bool editColor(const char* label, sf::Color& c)
+    {
+        float rgba[4] = { c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f };
+        if (!ImGui::ColorEdit4(label, rgba, ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_AlphaBar))
+            return false;
+
+        c.r = static_cast<sf::Uint8>(rgba[0] * 255);
+        c.g = static_cast<sf::Uint8>(rgba[1] * 255);
+        c.b = static_cast<sf::Uint8>(rgba[2] * 255);
+        c.a = static_cast<sf::Uint8>(rgba[3] * 255);
+        return true;
+    }
+}
+
+void ParticleUI::drawGradient(ColorGradient& gradient)
+{
+    if (!ImGui::CollapsingHeader("Color over Life", ImGuiTreeNodeFlags_DefaultOpen))
+        return;
+
+    const char* preview = m_palette >= 0 ?
+        ColorGradient::presetName(static_cast<ColorGradient::Preset>(m_palette)) : "Custom";
+    if (ImGui::BeginCombo("Palette", preview))
+    {
+        for (int i = 0; i < static_cast<int>(ColorGradient::Preset::Count); i++)
+        {
+            const ColorGradient::Preset preset = static_cast<ColorGradient::Preset>(i);
+            if (ImGui::Selectable(ColorGradient::presetName(preset), i == m_palette))
+            {
+                gradient = ColorGradient::preset(preset);
+                m_palette = i;
+                m_changed = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+
+    // Preview strip from spawn (left) to death (right).
+    const int segments = 64;
+    const float width = ImGui::CalcItemWidth();
+    const float height = ImGui::GetFrameHeight();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (int i = 0; i < segments; i++)
+    {
+        const ImU32 left = toImU32(gradient.sample(static_cast<float>(i) / segments));
+        const ImU32 right = toImU32(gradient.sample(static_cast<float>(i + 1) / segments));
+        const ImVec2 min(origin.x + width * i / segments, origin.y);
+        const ImVec2 max(origin.x + width * (i + 1) / segments, origin.y + height);
+        drawList->AddRectFilledMultiColor(min, max, left, right, right, left);
+    }
+    ImGui::Dummy(ImVec2(width, height));
+
+    bool edited = false;
+    for (int i = 0; i < gradient.count; i++)
+    {
+        ColorGradient::Stop& stop = gradient.stops[i];
+        ImGui::PushID(i);
+        ImGui::SetNextItemWidth(width * 0.6f);
+        edited |= ImGui::SliderFloat("##position", &stop.position, 0.0f, 1.0f, "%.2f");
+        ImGui::SameLine();
+        edited |= editColor("##color", stop.color);
+        ImGui::SameLine();
+        const bool remove = gradient.count > 1 && ImGui::Button("Remove");
+        ImGui::PopID();
+
+        if (remove)
+        {
+            gradient.removeStop(i);
+            edited = true;
+            break;
+        }
+    }
+
+    if (gradient.count < ColorGradient::kMaxStops && ImGui::Button("Add Stop"))
+    {
+        gradient.addStop(0.5f, gradient.sample(0.5f));
+        edited = true;
+    }
+
+    if (edited)
+    {
+        m_palette = -1;
+        m_changed = true;
+    }
+}
+
+void ParticleUI::draw(const ParticleSys& particles)
+{
+    ImGui::Begin("Particles");
+
+    ParticleSys::EmitterSettings& settings = m_params.emitter;
+
+    m_changed |= ImGui::SliderFloat("Size", &m_params.size, 1.0f, 10.0f);
+    m_changed |= ImGui::SliderFloat("Quantity", &settings.count, 100.0f, 100000.0f);
+    m_changed |= ImGui::SliderFloat("Time", &settings.particleLife, 0.5f, 2.5f, "%.2f s");
+
+    if (ImGui::BeginCombo("Shape", ParticleSys::shapeName(settings.shape)))
+    {
+        for (int i = 0; i < static_cast<int>(ParticleSys::ParticleShape::Count); i++)
+        {
+            const ParticleSys::ParticleShape shape = static_cast<ParticleSys::ParticleShape>(i);
+            if (ImGui::Selectable(ParticleSys::shapeName(shape), shape == settings.shape))
+            {
+                settings.shape = shape;
+                m_changed = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+
+    drawGradient(settings.gradient);
+
+    m_changed |= ImGui::SliderFloat("Emitter Life", &settings.emitterLife, 0.0f, 10.0f, "%.1f s");
+
+    const ParticleKernels::KernelSet& current = ParticleKernels::get(m_params.kernels);
+    if (ImGui::BeginCombo("Kernels", current.name))
+    {
+        for (int i = 0; i < static_cast<int>(ParticleKernels::Isa::Count); i++)
+        {
+            ParticleKernels::Isa isa = static_cast<ParticleKernels::Isa>(i);
+            if (!ParticleKernels::isSupported(isa))
+                continue;
+
+            const ParticleKernels::KernelSet& set = ParticleKernels::get(isa);
+            if (ImGui::Selectable(set.name, &set == &current))
+            {
+                m_params.kernels = isa;
+                m_changed = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+
+    ImGui::InputInt("Seed", &m_seed);
+    ImGui::SameLine();
+    if (ImGui::Button("Replay"))
+    {
+        m_replay = true;
+    }
+
+    int threads = static_cast<int>(m_params.threads);
+    if (ImGui::SliderInt("Threads", &threads, 1, static_cast<int>(WorkerPool::hardwareThreads())))
+    {
+        m_params.threads = static_cast<unsigned>(threads);
+        m_changed = true;
+    }
+
+    ImGui::Text("Emitters: %d", static_cast<int>(particles.getEmitterCount()));
+    ImGui::Text("Alive: %d / %d", static_cast<int>(particles.getAliveCount()), static_cast<int>(particles.getCapacity()));
+
+    const std::vector<double>& times = particles.getThreadTimes();
+    for (size_t t = 0; t < times.size(); t++)
+        ImGui::Text("Thread %d: %.3f ms update", static_cast<int>(t), times[t]);
+
+    ImGui::End();
+}
+
+bool ParticleUI::takeChanges(ParticleSys::Params& params)
+{
+    if (!m_changed)
+        return false;
+
+    params = m_params;
+    m_changed = false;
+    return true;
+}
+
+bool ParticleUI::takeReplay(uint64_t& seed)
+{
+    if (!m_replay)
+        return false;
+
+    seed = static_cast<uint64_t>(m_seed);
+    m_replay = false;
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "ParticleSys.h"
+#include <cstdint>
+
+// ImGui editor for ParticleSys::Params. It edits its own copy of the
+// parameters and only reads from the particle system, so the simulation never
+// runs ImGui code; the owner hands the edits over between updates.
+class ParticleUI
+{
+    ParticleSys::Params m_params;
+    bool m_changed = false;
+    int m_seed = 1;
+    bool m_replay = false;
+    // Preset the gradient was last loaded from, or -1 once it was edited.
+    int m_palette = static_cast<int>(ColorGradient::Preset::Fire);
+
+    void drawGradient(ColorGradient& gradient);
+
+public:
+    explicit ParticleUI(const ParticleSys::Params& params) : m_params(params) {}
+
+    // Builds the "Particles" window; statistics are read from particles.
+    void draw(const ParticleSys& particles);
+
+    // Copies the edited parameters to params if they changed since the last
+    // call.
+    bool takeChanges(ParticleSys::Params& params);
+
+    // Returns true once after "Replay" was pressed, with the seed to use.
+    bool takeReplay(uint64_t& seed);
+};
@@ -0,0 +1,285 @@
+#include "Profiler.h"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    std::mutex g_registerMutex;
+    const char* g_zoneNames[Profiler::kMaxZones];
+    std::atomic<int> g_zoneCount{ 0 };
+
+    // Nanoseconds per zone in the frame that is still open.
+    std::atomic<unsigned long long> g_openFrame[Profiler::kMaxZones];
+    std::atomic<unsigned long long> g_openAllocations[Profiler::kMaxZones];
+    std::atomic<unsigned long long> g_openBytes[Profiler::kMaxZones];
+
+    Profiler::Frame g_ring[Profiler::kHistory];
+    // Frames closed so far. Released after the slot is written, so a reader
+    // that acquires it sees complete frames.
+    std::atomic<unsigned long long> g_closedFrames{ 0 };
+    Profiler::Clock::time_point g_frameStart = Profiler::Clock::now();
+    AllocTracker::Counts g_frameAllocs;
+
+    // ---- Trace capture --------------------------------------------------
+
+    struct TraceEvent
+    {
+        const char* name;
+        Profiler::Clock::time_point start;
+        Profiler::Clock::time_point end;
+    };
+
+    // Events of one thread. Only that thread appends to it, so recording
+    // needs no lock. A thread that exits retires its buffer, and a new
+    // thread takes over a retired one once its events have been cleared, so
+    // restarting a worker pool does not add tracks.
+    struct ThreadTrace
+    {
+        unsigned id = 0;
+        const char* name = nullptr;
+        bool retired = false;
+        std::vector<TraceEvent> events;
+    };
+
+    // Upper bound per thread, about 100 MB of events in all for a handful of
+    // threads; later events of a full buffer are dropped.
+    const std::size_t kMaxTraceEvents = 1 << 20;
+
+    std::mutex g_traceMutex;
+    std::vector<std::unique_ptr<ThreadTrace>> g_threadTraces;
+    Profiler::Clock::time_point g_traceStart;
+
+    // The calling thread's buffer, retired when the thread exits.
+    struct ThreadTraceSlot
+    {
+        ThreadTrace* trace = nullptr;
+
+        ~ThreadTraceSlot()
+        {
+            if (trace == nullptr)
+                return;
+            std::lock_guard<std::mutex> lock(g_traceMutex);
+            trace->retired = true;
+        }
+    };
+
+    thread_local ThreadTraceSlot t_threadTrace;
+
+    ThreadTrace& threadTrace()
+    {
+        if (t_threadTrace.trace == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(g_traceMutex);
+            for (const auto& trace : g_threadTraces)
+            {
+                if (trace->retired && trace->events.empty())
+                {
+                    t_threadTrace.trace = trace.get();
+                    break;
+                }
+            }
+            if (t_threadTrace.trace == nullptr)
+            {
+                g_threadTraces.emplace_back(new ThreadTrace());
+                t_threadTrace.trace = g_threadTraces.back().get();
+                t_threadTrace.trace->id = static_cast<unsigned>(g_threadTraces.size());
+            }
+            t_threadTrace.trace->name = nullptr;
+            t_threadTrace.trace->retired = false;
+        }
+        return *t_threadTrace.trace;
+    }
+
+    double toMicroseconds(Profiler::Clock::time_point t)
+    {
+        return std::chrono::duration<double, std::micro>(t - g_traceStart).count();
+    }
+}
+
+namespace Profiler
+{
+    int registerZone(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(g_registerMutex);
+        const int count = g_zoneCount.load(std::memory_order_relaxed);
+        for (int zone = 0; zone < count; zone++)
+        {
+            if (std::strcmp(g_zoneNames[zone], name) == 0)
+                return zone;
+        }
+        if (count == kMaxZones)
+            return -1;
+
+        g_zoneNames[count] = name;
+        g_zoneCount.store(count + 1, std::memory_order_release);
+        return count;
+    }
+
+    int getZoneCount()
+    {
+        return g_zoneCount.load(std::memory_order_acquire);
+    }
+
+    const char* getZoneName(int zone)
+    {
+        return zone >= 0 && zone < getZoneCount() ? g_zoneNames[zone] : "";
+    }
+
+    void addTime(int zone, Clock::duration elapsed)
+    {
+        if (zone < 0)
+            return;
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        g_openFrame[zone].fetch_add(static_cast<unsigned long long>(ns), std::memory_order_relaxed);
+    }
+
+    void addAllocations(int zone, const AllocTracker::Counts& counts)
+    {
+        if (zone < 0)
+            return;
+        g_openAllocations[zone].fetch_add(counts.allocations, std::memory_order_relaxed);
+        g_openBytes[zone].fetch_add(counts.bytes, std::memory_order_relaxed);
+    }
+
+    void endFrame()
+    {
+        const Clock::time_point now = Clock::now();
+        if (isTracing())
+            detail::traceEvent("Frame", g_frameStart, now);
+
+        const unsigned long long closed = g_closedFrames.load(std::memory_order_relaxed);
+
+        Frame& frame = g_ring[closed % kHistory];
+        frame.frameMs = std::chrono::duration<float, std::milli>(now - g_frameStart).count();
+        for (int zone = 0; zone < kMaxZones; zone++)
+        {
+            frame.zoneMs[zone] = g_openFrame[zone].exchange(0, std::memory_order_relaxed) * 1e-6f;
+            frame.zoneAllocations[zone] = static_cast<unsigned>(g_openAllocations[zone].exchange(0, std::memory_order_relaxed));
+            frame.zoneBytes[zone] = g_openBytes[zone].exchange(0, std::memory_order_relaxed);
+        }
+
+        const AllocTracker::Counts allocs = AllocTracker::total();
+        frame.allocations = static_cast<unsigned>(allocs.allocations - g_frameAllocs.allocations);
+        frame.allocatedBytes = allocs.bytes - g_frameAllocs.bytes;
+
+        g_frameStart = now;
+        g_frameAllocs = allocs;
+        g_closedFrames.store(closed + 1, std::memory_order_release);
+    }
+
+    std::size_t getFrameCount()
+    {
+        const unsigned long long closed = g_closedFrames.load(std::memory_order_acquire);
+        return closed < kHistory ? static_cast<std::size_t>(closed) : kHistory;
+    }
+
+    const Frame& getFrame(std::size_t age)
+    {
+        const unsigned long long closed = g_closedFrames.load(std::memory_order_acquire);
+        return g_ring[(closed - 1 - age) % kHistory];
+    }
+
+    bool writeCsv(const char* path, std::size_t frames)
+    {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+
+        const int zones = getZoneCount();
+        file << "frame,frame_ms,frame_allocs,frame_bytes";
+        for (int zone = 0; zone < zones; zone++)
+            file << ',' << getZoneName(zone);
+        for (int zone = 0; zone < zones; zone++)
+            file << ',' << getZoneName(zone) << " allocs";
+        file << '\n' << std::fixed << std::setprecision(4);
+
+        const std::size_t count = frames < getFrameCount() ? frames : getFrameCount();
+        for (std::size_t i = 0; i < count; i++)
+        {
+            const Frame& frame = getFrame(count - 1 - i);
+            file << i << ',' << frame.frameMs << ',' << frame.allocations << ',' << frame.allocatedBytes;
+            for (int zone = 0; zone < zones; zone++)
+                file << ',' << frame.zoneMs[zone];
+            for (int zone = 0; zone < zones; zone++)
+                file << ',' << frame.zoneAllocations[zone];
+            file << '\n';
+        }
+        file.close();
+        return !file.fail();
+    }
+
+    void startTrace()
+    {
+        std::lock_guard<std::mutex> lock(g_traceMutex);
+        for (const auto& trace : g_threadTraces)
+            trace->events.clear();
+        g_traceStart = Clock::now();
+        detail::tracing.store(true, std::memory_order_relaxed);
+    }
+
+    bool stopTrace(const char* path)
+    {
+        detail::tracing.store(false, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(g_traceMutex);
+
+        std::ofstream file(path);
+        if (!file)
+            return false;
+
+        // Complete ("X") events with microsecond timestamps, plus one
+        // metadata event per thread naming its track.
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" << std::fixed << std::setprecision(3);
+        bool first = true;
+        for (const auto& trace : g_threadTraces)
+        {
+            // Threads that exited without recording anything get no track.
+            if (trace->retired && trace->events.empty())
+                continue;
+
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << trace->id
+                << ",\"args\":{\"name\":\"";
+            if (trace->name != nullptr)
+                file << trace->name;
+            else
+                file << "Thread " << trace->id;
+            file << "\"}}";
+            first = false;
+
+            for (const TraceEvent& event : trace->events)
+            {
+                const double start = toMicroseconds(event.start);
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace->id
+                    << ",\"ts\":" << start << ",\"dur\":" << toMicroseconds(event.end) - start << "}";
+            }
+        }
+        file << "\n]}\n";
+        file.close();
+        return !file.fail();
+    }
+
+    void setThreadName(const char* name)
+    {
+        ThreadTrace& trace = threadTrace();
+        std::lock_guard<std::mutex> lock(g_traceMutex);
+        trace.name = name;
+    }
+
+    namespace detail
+    {
+        std::atomic<bool> tracing{ false };
+
+        void traceEvent(const char* name, Clock::time_point start, Clock::time_point end)
+        {
+            ThreadTrace& trace = threadTrace();
+            if (trace.events.size() < kMaxTraceEvents)
+            {
+                TraceEvent event = { name, start, end };
+                trace.events.push_back(event);
+            }
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "AllocTracker.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Frame-phase profiler. Code marks named zones with PROFILE_ZONE; the time
+// spent in each zone is summed over a frame and endFrame() moves the totals
+// into a fixed ring of recent frames. Zones may run on any thread: the totals
+// are atomics and the ring is written only by the thread calling endFrame(),
+// so nothing takes a lock after a zone's first use. Zones also count the heap
+// allocations their thread made while they ran, through AllocTracker.
+//
+// While a trace is being recorded every zone is also logged as an event in a
+// buffer of the thread it ran on, and stopTrace() writes them all as Chrome
+// trace-event JSON for chrome://tracing or ui.perfetto.dev. When no trace is
+// recorded this costs one relaxed atomic load per zone. Growing those buffers
+// shows up as an occasional allocation in the zones that enclose it.
+namespace Profiler
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int kMaxZones = 32;
+    // Frames kept in the ring, ten seconds at 60 Hz.
+    const std::size_t kHistory = 600;
+
+    struct Frame
+    {
+        // Wall time from the previous endFrame() to this one.
+        float frameMs = 0.0f;
+        // Time spent in every zone during the frame, summed over threads.
+        float zoneMs[kMaxZones] = {};
+        // Heap allocations made during the frame by all threads, and by
+        // every zone. A zone's counts include those of zones nested in it.
+        unsigned allocations = 0;
+        unsigned long long allocatedBytes = 0;
+        unsigned zoneAllocations[kMaxZones] = {};
+        unsigned long long zoneBytes[kMaxZones] = {};
+    };
+
+    // Returns the id of the zone with this name, adding it on first use.
+    // Names must outlive the profiler, string literals in practice. Returns
+    // -1 once kMaxZones zones exist.
+    int registerZone(const char* name);
+    int getZoneCount();
+    const char* getZoneName(int zone);
+
+    void addTime(int zone, Clock::duration elapsed);
+    void addAllocations(int zone, const AllocTracker::Counts& counts);
+
+    // Closes the current frame. Call once per displayed frame from one thread.
+    void endFrame();
+
+    // Number of frames in the ring, at most kHistory.
+    std::size_t getFrameCount();
+    // Frame age frames before the newest one; age 0 is the newest.
+    const Frame& getFrame(std::size_t age);
+
+    // Writes the newest frames, oldest first, one row per frame with a time
+    // and an allocation column per zone. Returns false if the file could not be written.
+    bool writeCsv(const char* path, std::size_t frames);
+
+    // Starts logging zones as trace events, dropping any earlier capture.
+    void startTrace();
+    // Stops logging and writes the captured events to path. Call between
+    // frames, while no zones run on other threads.
+    bool stopTrace(const char* path);
+    // Name of the calling thread in traces; unnamed threads are numbered.
+    void setThreadName(const char* name);
+
+    namespace detail
+    {
+        extern std::atomic<bool> tracing;
+        void traceEvent(const char* name, Clock::time_point start, Clock::time_point end);
+    }
+
+    inline bool isTracing()
+    {
+        return detail::tracing.load(std::memory_order_relaxed);
+    }
+
+    // Adds the time and the allocations from construction to destruction to
+    // a zone.
+    class Scope
+    {
+        int m_zone;
+        AllocTracker::Counts m_allocs;
+        Clock::time_point m_start;
+
+    public:
+        explicit Scope(int zone) : m_zone(zone), m_allocs(AllocTracker::thisThread()), m_start(Clock::now()) {}
+
+        ~Scope()
+        {
+            const Clock::time_point end = Clock::now();
+            addTime(m_zone, end - m_start);
+            const AllocTracker::Counts allocs = AllocTracker::thisThread();
+            if (allocs.allocations != m_allocs.allocations)
+            {
+                AllocTracker::Counts made;
+                made.allocations = allocs.allocations - m_allocs.allocations;
+                made.bytes = allocs.bytes - m_allocs.bytes;
+                addAllocations(m_zone, made);
+            }
+            if (isTracing())
+                detail::traceEvent(getZoneName(m_zone), m_start, end);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing block as the zone called name.
+#define PROFILE_ZONE(name) \
+    static const int PROFILE_CONCAT(profileZone, __LINE__) = Profiler::registerZone(name); \
+    Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__))
@@ -0,0 +1,172 @@
+#include "ProfilerUI.h"
+#include "Profiler.h"
+#include <imgui.h>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+ProfilerUI::ProfilerUI()
+    : m_plot(Profiler::kHistory), m_sorted(Profiler::kHistory),
+    m_csvFrames(static_cast<int>(Profiler::kHistory))
+{
+}
+
+float ProfilerUI::percentile(const std::vector<float>& values, std::size_t count, float p)
+{
+    if (count == 0)
+        return 0.0f;
+
+    std::copy(values.begin(), values.begin() + count, m_sorted.begin());
+    const std::size_t rank = std::min(count - 1, static_cast<std::size_t>(p * count));
+    std::nth_element(m_sorted.begin(), m_sorted.begin() + rank, m_sorted.begin() + count);
+    return m_sorted[rank];
+}
+
+void ProfilerUI::draw()
+{
+    ImGui::Begin("Profiler");
+
+    const std::size_t count = Profiler::getFrameCount();
+    const int zones = Profiler::getZoneCount();
+    if (count == 0)
+    {
+        ImGui::Text("No frames recorded yet.");
+        ImGui::End();
+        return;
+    }
+    if (m_selectedZone >= zones)
+        m_selectedZone = -1;
+
+    // Oldest frame first, so the graph scrolls to the left.
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const Profiler::Frame& frame = Profiler::getFrame(count - 1 - i);
+        m_plot[i] = m_selectedZone < 0 ? frame.frameMs : frame.zoneMs[m_selectedZone];
+    }
+
+    const float p50 = percentile(m_plot, count, 0.50f);
+    const float p95 = percentile(m_plot, count, 0.95f);
+    const float p99 = percentile(m_plot, count, 0.99f);
+
+    char overlay[96];
+    std::snprintf(overlay, sizeof(overlay), "%s: %.2f ms",
+        m_selectedZone < 0 ? "Frame" : Profiler::getZoneName(m_selectedZone), m_plot[count - 1]);
+    ImGui::PlotLines("##history", m_plot.data(), static_cast<int>(count), 0, overlay,
+        0.0f, std::max(p99 * 1.25f, 1.0f), ImVec2(-1.0f, 80.0f));
+    ImGui::Text("p50 %.2f ms   p95 %.2f ms   p99 %.2f ms   (%d frames)", p50, p95, p99, static_cast<int>(count));
+
+    const Profiler::Frame& newest = Profiler::getFrame(0);
+    int allocatingFrames = 0;
+    for (std::size_t i = 0; i < count; i++)
+        allocatingFrames += Profiler::getFrame(i).allocations != 0 ? 1 : 0;
+    ImGui::Text("Allocations: %u (%llu bytes) last frame, %d of %d frames allocated",
+        newest.allocations, newest.allocatedBytes, allocatingFrames, static_cast<int>(count));
+
+    if (ImGui::BeginTable("zones", 7, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+    {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("Last");
+        ImGui::TableSetupColumn("Avg");
+        ImGui::TableSetupColumn("p95");
+        ImGui::TableSetupColumn("p99");
+        ImGui::TableSetupColumn("Allocs");
+        ImGui::TableSetupColumn("Bytes");
+        ImGui::TableHeadersRow();
+
+        for (int zone = -1; zone < zones; zone++)
+        {
+            float sum = 0.0f;
+            double allocations = 0.0;
+            double bytes = 0.0;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                const Profiler::Frame& frame = Profiler::getFrame(count - 1 - i);
+                m_plot[i] = zone < 0 ? frame.frameMs : frame.zoneMs[zone];
+                sum += m_plot[i];
+                allocations += zone < 0 ? frame.allocations : frame.zoneAllocations[zone];
+                bytes += static_cast<double>(zone < 0 ? frame.allocatedBytes : frame.zoneBytes[zone]);
+            }
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (ImGui::Selectable(zone < 0 ? "Frame" : Profiler::getZoneName(zone), zone == m_selectedZone,
+                ImGuiSelectableFlags_SpanAllColumns))
+            {
+                m_selectedZone = zone;
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", m_plot[count - 1]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", sum / count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", percentile(m_plot, count, 0.95f));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", percentile(m_plot, count, 0.99f));
+            // Averages per frame, so a zone that allocates now and then
+            // does not read as zero.
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", allocations / count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", bytes / count);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::SliderInt("CSV Frames", &m_csvFrames, 1, static_cast<int>(Profiler::kHistory));
+    if (ImGui::Button("Save CSV (F2)"))
+    {
+        saveCsv();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(Profiler::isTracing() ? "Stop Trace (F3)" : "Record Trace (F3)"))
+    {
+        toggleTrace();
+    }
+    if (m_status[0] != '\0')
+    {
+        ImGui::TextUnformatted(m_status);
+    }
+
+    ImGui::End();
+}
+
+void ProfilerUI::saveCsv()
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "profile_%lld.csv", static_cast<long long>(std::time(nullptr)));
+
+    if (Profiler::writeCsv(path, static_cast<std::size_t>(m_csvFrames)))
+        std::snprintf(m_status, sizeof(m_status), "Saved %s", path);
+    else
+        std::snprintf(m_status, sizeof(m_status), "Could not write %s", path);
+}
+
+void ProfilerUI::startTrace(const char* path)
+{
+    if (path != nullptr)
+        std::snprintf(m_tracePath, sizeof(m_tracePath), "%s", path);
+    else
+        std::snprintf(m_tracePath, sizeof(m_tracePath), "trace_%lld.json", static_cast<long long>(std::time(nullptr)));
+
+    Profiler::startTrace();
+    std::snprintf(m_status, sizeof(m_status), "Recording %s", m_tracePath);
+}
+
+void ProfilerUI::stopTrace()
+{
+    if (!Profiler::isTracing())
+        return;
+
+    if (Profiler::stopTrace(m_tracePath))
+        std::snprintf(m_status, sizeof(m_status), "Saved %s", m_tracePath);
+    else
+        std::snprintf(m_status, sizeof(m_status), "Could not write %s", m_tracePath);
+}
+
+void ProfilerUI::toggleTrace()
+{
+    if (Profiler::isTracing())
+        stopTrace();
+    else
+        startTrace();
+}
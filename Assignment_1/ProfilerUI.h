@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+
+// ImGui view of the Profiler ring: a frame-time graph, frame-time
+// percentiles and a per-zone table of times and heap allocations. Clicking
+// a zone graphs that zone instead of the whole frame.
+class ProfilerUI
+{
+    std::vector<float> m_plot;
+    // Scratch for percentiles, sized once so drawing does not allocate.
+    std::vector<float> m_sorted;
+    int m_selectedZone = -1;
+    int m_csvFrames;
+    char m_tracePath[260] = "";
+    // Room for the longest message, "Could not write " and a trace path.
+    char m_status[sizeof("Could not write ") + sizeof(m_tracePath)] = "";
+
+    float percentile(const std::vector<float>& values, std::size_t count, float p);
+
+public:
+    ProfilerUI();
+
+    // Builds the "Profiler" window.
+    void draw();
+
+    // Writes the newest "CSV Frames" frames to profile_<time>.csv in the
+    // working directory.
+    void saveCsv();
+
+    // Starts recording a trace that stopTrace() writes to path, or to
+    // trace_<time>.json when path is null.
+    void startTrace(const char* path = nullptr);
+    void stopTrace();
+    void toggleTrace();
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// xoshiro128+ generator (Blackman & Vigna) for simulation randomness. Each
+// instance is an independent stream selected by (seed, stream), so systems
+// that update in parallel can give every chunk of work its own stream and
+// still replay exactly from the same seed on any platform.
+class Random
+{
+public:
+    explicit Random(uint64_t seedValue = 1, uint64_t stream = 0)
+    {
+        seed(seedValue, stream);
+    }
+
+    void seed(uint64_t seedValue, uint64_t stream = 0)
+    {
+        // splitmix64 spreads the seed/stream pair over the whole state.
+        uint64_t x = seedValue ^ (stream * 0xD1B54A32D192ED03ULL);
+        for (int i = 0; i < 4; i += 2)
+        {
+            uint64_t z = splitmix64(x);
+            s[i] = static_cast<uint32_t>(z);
+            s[i + 1] = static_cast<uint32_t>(z >> 32);
+        }
+        if ((s[0] | s[1] | s[2] | s[3]) == 0)
+            s[0] = 1;
+    }
+
+    uint32_t nextUInt()
+    {
+        const uint32_t result = s[0] + s[3];
+        const uint32_t t = s[1] << 9;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+
+        return result;
+    }
+
+    // Uniform integer in [0, bound) using a multiply-shift instead of modulo.
+    uint32_t nextUInt(uint32_t bound)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(nextUInt()) * bound) >> 32);
+    }
+
+    // Uniform float in [0, 1). Uses the top 24 bits, the best-mixed ones.
+    float nextFloat()
+    {
+        return (nextUInt() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float nextFloat(float min, float max)
+    {
+        return min + (max - min) * nextFloat();
+    }
+
+    // Uniform angle in [0, 2*pi). The product can round up to 2*pi itself,
+    // so it is clamped to the float just below.
+    float nextAngle()
+    {
+        return std::min(nextFloat() * kTwoPi, maxAngle());
+    }
+
+    void fillFloats(float* out, std::size_t n, float min = 0.0f, float max = 1.0f)
+    {
+        const float scale = (max - min) * (1.0f / 16777216.0f);
+        for (std::size_t i = 0; i < n; i++)
+            out[i] = min + (nextUInt() >> 8) * scale;
+    }
+
+    // Uniform angles in [0, 2*pi), clamped like nextAngle().
+    void fillAngles(float* out, std::size_t n)
+    {
+        fillFloats(out, n, 0.0f, kTwoPi);
+        const float maxValue = maxAngle();
+        for (std::size_t i = 0; i < n; i++)
+            out[i] = std::min(out[i], maxValue);
+    }
+
+    void fillUInts(uint32_t* out, std::size_t n, uint32_t bound)
+    {
+        for (std::size_t i = 0; i < n; i++)
+            out[i] = nextUInt(bound);
+    }
+
+private:
+    static constexpr float kTwoPi = 6.28318531f;
+
+    static float maxAngle()
+    {
+        return std::nextafter(kTwoPi, 0.0f);
+    }
+
+    static uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    static uint64_t splitmix64(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint32_t s[4];
+};
@@ -1,11 +1,65 @@
 #pragma once
 #include <SFML/Graphics.hpp>
+#include <algorithm>
 
 class SceneInterface {
 public:
     virtual void handleEvent(const sf::Event& event, sf::RenderWindow& window) = 0;
+    // Advances the simulation by one fixed step of dt seconds. May run any
+    // number of times per displayed frame, including none.
     virtual void update(float dt) = 0;
-    virtual void render(sf::RenderWindow& window) = 0;
+    // Builds the scene's ImGui windows; called once per displayed frame.
+    // Edits go to the scene's pending parameters, not the simulation.
+    virtual void renderGUI() {}
+    // Hands the parameters edited in renderGUI() over to the simulation.
+    // Called once per frame after renderGUI() and before any update().
+    virtual void applyParams() {}
+    // alpha in [0, 1] is how far the displayed frame lies between the last
+    // two simulation steps.
+    virtual void render(sf::RenderWindow& window, float alpha) = 0;
     virtual ~SceneInterface() = default;
 };
 
+// Accumulates real frame time and turns it into a whole number of fixed
+// simulation steps, so the simulation rate does not depend on the display
+// rate. If a frame falls too far behind, the steps past maxSteps are dropped
+// instead of slowing every following frame down further.
+class FixedStep {
+    float step;
+    int maxSteps;
+    float accumulator = 0.0f;
+    int lastSteps = 0;
+
+public:
+    explicit FixedStep(float rate = 60.0f, int maxSteps = 5)
+        : step(1.0f / rate), maxSteps(maxSteps) {}
+
+    void setRate(float rate) { step = 1.0f / rate; }
+    float getRate() const { return 1.0f / step; }
+    float getStep() const { return step; }
+
+    void setMaxSteps(int steps) { maxSteps = std::max(1, steps); }
+    int getMaxSteps() const { return maxSteps; }
+
+    // Adds frameTime seconds and returns how many steps to run this frame.
+    int advance(float frameTime) {
+        accumulator += frameTime;
+        int steps = static_cast<int>(accumulator / step);
+        if (steps > maxSteps) {
+            steps = maxSteps;
+            accumulator = 0.0f;
+        }
+        else {
+            accumulator -= steps * step;
+        }
+        lastSteps = steps;
+        return steps;
+    }
+
+    int getLastSteps() const { return lastSteps; }
+
+    // Fraction of a step left in the accumulator, used to interpolate
+    // between the previous and the current simulation state.
+    float getAlpha() const { return std::min(accumulator / step, 1.0f); }
+};
+
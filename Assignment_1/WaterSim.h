@@ -0,0 +1,878 @@
+#pragma once
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "Profiler.h"
+#include "WorkerPool.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const float g = 9.81f;
+const float waveDamping = 0.97f;
+// Courant number (wave speed * step / column width) the wave substeps are
+// sized for. The explicit stencil is stable up to 1.
+const float waveCourant = 0.9f;
+// Wave substeps per update at most, so a very fine or fast surface slows the
+// simulation down instead of stalling the frame.
+const int maxWaveSubsteps = 512;
+
+// How the water surface is stepped. Explicit follows the stencil with CFL
+// substeps and damping; Implicit takes one backward Euler step per update,
+// stable at any step length and wave speed.
+enum class WaveSolver { Explicit, Implicit };
+const float waterDensity = 1000.0f;
+const float airDensity = 1.225f;
+const float dragCoefficient = 0.47f;
+const float SCALE = 100.0f;
+const float equilibriumThreshold = 20.0f;
+// Step length the damping constants were tuned for.
+const float waveReferenceStep = 0.01f;
+// Share of the approach speed two colliding balls keep.
+const float ballRestitution = 0.5f;
+
+struct Water;
+
+struct Ball {
+    sf::Vector2f position;
+    sf::Vector2f previousPosition;
+    sf::Vector2f velocity;
+    float radius;
+    float mass;
+    float volume;
+    bool inWater = false;
+    bool atEquilibrium = false;
+    bool wasInWater = false;
+
+    Ball(float x, float y, float r, float m)
+        : position(x, y), previousPosition(x, y), radius(r), mass(m) {
+        volume = static_cast<float>((4.0 / 3.0) * M_PI * std::pow(radius, 3));
+        velocity = sf::Vector2f(0, 0);
+    }
+
+    sf::Vector2f getGravityAndAirResistance(float dt) {
+        sf::Vector2f gravityForce(0, mass * g);
+        float area = M_PI * std::pow(radius, 2);
+        float dragForce = 0.5f * dragCoefficient * airDensity * std::pow(velocity.y, 2) * area;
+        sf::Vector2f airResistance(0, (velocity.y > 0 ? -dragForce : dragForce));
+        return inWater ? sf::Vector2f(0, gravityForce.y) : (gravityForce + airResistance);
+    }
+
+    void applyForce(sf::Vector2f force, float dt) {
+        velocity += (force / mass) * dt;
+    }
+
+    void update(float dt) {
+
+        position += velocity * dt;
+    }
+};
+
+// Ball-ball contacts. The broad phase is a uniform grid over the balls'
+// bounding box with cells at least as wide as the largest ball, so touching
+// balls always lie in neighbouring cells. Balls are counting-sorted by cell
+// in row-major order and their positions copied in that order, so the three
+// cells of a neighbouring row are one contiguous range and each ball scans
+// three short ranges. The cost grows linearly with the ball count. The
+// buffers are kept between steps and stop allocating once they have grown to
+// the ball count.
+class BallCollisions {
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> ballCell;
+    std::vector<uint32_t> sorted;
+    std::vector<float> sortedX;
+    std::vector<float> sortedY;
+    std::vector<float> sortedRadius;
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float inverseCellSize = 1.0f;
+    int columns = 0;
+    int rows = 0;
+
+    void build(const std::vector<Ball>& balls) {
+        const size_t count = balls.size();
+        float minX = balls[0].position.x, maxX = minX;
+        float minY = balls[0].position.y, maxY = minY;
+        float maxRadius = 0.0f;
+        for (const auto& ball : balls) {
+            minX = std::min(minX, ball.position.x);
+            maxX = std::max(maxX, ball.position.x);
+            minY = std::min(minY, ball.position.y);
+            maxY = std::max(maxY, ball.position.y);
+            maxRadius = std::max(maxRadius, ball.radius);
+        }
+
+        // Cells are doubled in size while there would be more than about
+        // four per ball, so balls flung far apart cannot blow up the grid.
+        float cellSize = std::max(2.0f * maxRadius, 1e-3f);
+        const double maxCells = 4.0 * count + 64.0;
+        while ((std::floor((maxX - minX) / cellSize) + 1.0) * (std::floor((maxY - minY) / cellSize) + 1.0) > maxCells) {
+            cellSize *= 2.0f;
+        }
+        inverseCellSize = 1.0f / cellSize;
+        originX = minX;
+        originY = minY;
+        columns = static_cast<int>((maxX - minX) * inverseCellSize) + 1;
+        rows = static_cast<int>((maxY - minY) * inverseCellSize) + 1;
+
+        // Reserved for the largest grid, so a moving bounding box does not
+        // keep regrowing it.
+        const size_t cells = static_cast<size_t>(columns) * rows;
+        cellStart.reserve(static_cast<size_t>(maxCells) + 1);
+        cellStart.assign(cells + 1, 0);
+        ballCell.resize(count);
+        sorted.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            ballCell[i] = static_cast<uint32_t>(row(balls[i].position.y) * columns + column(balls[i].position.x));
+            cellStart[ballCell[i]]++;
+        }
+        // Running totals leave every cell's end in cellStart; filling
+        // backwards moves each back to its start and keeps balls in index
+        // order within a cell.
+        for (size_t c = 1; c < cells; c++) {
+            cellStart[c] += cellStart[c - 1];
+        }
+        cellStart[cells] = static_cast<uint32_t>(count);
+        for (size_t i = count; i-- > 0;) {
+            sorted[--cellStart[ballCell[i]]] = static_cast<uint32_t>(i);
+        }
+
+        sortedX.resize(count);
+        sortedY.resize(count);
+        sortedRadius.resize(count);
+        for (size_t k = 0; k < count; k++) {
+            const Ball& ball = balls[sorted[k]];
+            sortedX[k] = ball.position.x;
+            sortedY[k] = ball.position.y;
+            sortedRadius[k] = ball.radius;
+        }
+    }
+
+    int column(float x) const {
+        return std::min(static_cast<int>((x - originX) * inverseCellSize), columns - 1);
+    }
+
+    int row(float y) const {
+        return std::min(static_cast<int>((y - originY) * inverseCellSize), rows - 1);
+    }
+
+    static bool overlap(const Ball& a, const Ball& b) {
+        sf::Vector2f delta = b.position - a.position;
+        float minDistance = a.radius + b.radius;
+        return delta.x * delta.x + delta.y * delta.y < minDistance * minDistance;
+    }
+
+public:
+    // Calls visit(i, j) once for every pair of overlapping balls, i < j.
+    // Pairs are found from the positions at the call; visit may move balls,
+    // and resolve() leaves pairs alone that no longer overlap.
+    template <typename Visit>
+    void forEachContact(const std::vector<Ball>& balls, Visit visit) {
+        if (balls.empty()) {
+            return;
+        }
+        build(balls);
+
+        // Walking the balls in cell order keeps neighbouring queries on the
+        // same rows of the sorted arrays.
+        for (size_t k = 0; k < sorted.size(); k++) {
+            const float x = sortedX[k];
+            const float y = sortedY[k];
+            const float radius = sortedRadius[k];
+            const int cx = column(x);
+            const int cy = row(y);
+            const int firstColumn = std::max(cx - 1, 0);
+            const int lastColumn = std::min(cx + 1, columns - 1);
+
+            for (int r = std::max(cy - 1, 0); r <= std::min(cy + 1, rows - 1); r++) {
+                // Each pair is seen from both balls; only the later one in
+                // sorted order reports it.
+                const uint32_t begin = std::max(cellStart[r * columns + firstColumn], static_cast<uint32_t>(k + 1));
+                const uint32_t end = cellStart[r * columns + lastColumn + 1];
+                for (uint32_t m = begin; m < end; m++) {
+                    const float dx = sortedX[m] - x;
+                    const float dy = sortedY[m] - y;
+                    const float minDistance = radius + sortedRadius[m];
+                    if (dx * dx + dy * dy < minDistance * minDistance) {
+                        visit(std::min(sorted[k], sorted[m]), std::max(sorted[k], sorted[m]));
+                    }
+                }
+            }
+        }
+    }
+
+    // Reference broad phase testing every pair, for the benchmark.
+    template <typename Visit>
+    static void forEachContactAllPairs(const std::vector<Ball>& balls, Visit visit) {
+        for (size_t i = 0; i < balls.size(); i++) {
+            for (size_t j = i + 1; j < balls.size(); j++) {
+                if (overlap(balls[i], balls[j])) {
+                    visit(i, j);
+                }
+            }
+        }
+    }
+
+    // Pushes two overlapping balls apart along the line between their
+    // centres, in inverse proportion to their masses, and applies an
+    // impulse if they are moving towards each other.
+    static void resolve(Ball& a, Ball& b) {
+        sf::Vector2f delta = b.position - a.position;
+        float distance = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+        float penetration = a.radius + b.radius - distance;
+        if (penetration <= 0) {
+            return;
+        }
+        sf::Vector2f normal = distance > 1e-6f ? delta / distance : sf::Vector2f(0, -1);
+        float inverseA = 1.0f / a.mass;
+        float inverseB = 1.0f / b.mass;
+        float inverseSum = inverseA + inverseB;
+
+        a.position -= normal * (penetration * inverseA / inverseSum);
+        b.position += normal * (penetration * inverseB / inverseSum);
+
+        sf::Vector2f relative = b.velocity - a.velocity;
+        float approach = relative.x * normal.x + relative.y * normal.y;
+        if (approach < 0) {
+            float impulse = -(1.0f + ballRestitution) * approach / inverseSum;
+            a.velocity -= normal * (impulse * inverseA);
+            b.velocity += normal * (impulse * inverseB);
+        }
+    }
+
+    void resolve(std::vector<Ball>& balls) {
+        PROFILE_ZONE("Water/Collisions");
+        forEachContact(balls, [&balls](size_t i, size_t j) {
+            resolve(balls[i], balls[j]);
+        });
+    }
+};
+
+// What one ball step found about a ball and the water under it. Water's
+// interact() fills it once per ball; the force, the water level and the
+// waves all read it, so the cap below the surface is only worked out once.
+struct BallContact {
+    // Surface column under the ball, -1 outside the pool.
+    int column = -1;
+    // Depth of the ball's lowest point below the surface in pixels, at most
+    // the ball's diameter.
+    float capHeight = 0.0f;
+    // Volume of that cap in cubic metres, 0 while the ball is out of water.
+    float submergedVolume = 0.0f;
+    // Upward force of the water, and the sum of the velocity-dependent
+    // resistances.
+    float buoyancy = 0.0f;
+    float drag = 0.0f;
+    // Wave impulse of a ball that hit the surface in this step, else 0.
+    float waveImpulse = 0.0f;
+};
+
+struct Water {
+    std::vector<float> surfaceHeights;
+    std::vector<float> previousHeights;
+    std::vector<float> velocities;
+    // Back buffers the two wave passes write into before swapping them with
+    // surfaceHeights and velocities, so a step neither copies nor allocates.
+    std::vector<float> nextHeights;
+    std::vector<float> nextVelocities;
+    // Elimination factors of the implicit solve for the coupling in
+    // implicitCoupling, kept while the step length and speed do not change.
+    std::vector<float> implicitUpper;
+    std::vector<float> implicitInversePivot;
+    float implicitCoupling = -1.0f;
+    // Triangle strip of the pool, a surface and a bottom vertex per column.
+    // Built once with the pool; buildMesh() only rewrites the surface
+    // heights.
+    mutable std::vector<sf::Vertex> mesh;
+    // GPU copy of the mesh, streamed every frame where vertex buffers are
+    // supported. Created by the first draw: constructing a vertex buffer
+    // creates a GL context, which headless users such as Bench do not have.
+    mutable std::unique_ptr<sf::VertexBuffer> meshBuffer;
+    float left, right, top, bottom;
+    float dx;
+    float poolWidth;
+    float initialWaterVolume;
+    float lastTotalVolume;
+    // Volume of all balls below the surface, summed by the ball step.
+    float displacedVolume = 0.0f;
+
+    Water(float l, float t, float width, float height, int resolution = 400)
+        : left(l), top(t), right(l + width), bottom(t + height), poolWidth(width) {
+        dx = width / static_cast<float>(resolution);
+        initialWaterVolume = (width / SCALE) * ((bottom - top) / SCALE);
+        lastTotalVolume = initialWaterVolume;
+        for (int i = 0; i <= resolution; i++) {
+            surfaceHeights.push_back(top);
+            velocities.push_back(0.0f);
+        }
+        previousHeights = surfaceHeights;
+        nextHeights = surfaceHeights;
+        nextVelocities = velocities;
+        implicitUpper.resize(surfaceHeights.size());
+        implicitInversePivot.resize(surfaceHeights.size());
+        const sf::Color color(0, 100, 255, 180);
+        mesh.resize(surfaceHeights.size() * 2);
+        for (size_t i = 0; i < surfaceHeights.size(); i++) {
+            float x = left + i * dx;
+            mesh[2 * i] = sf::Vertex(sf::Vector2f(x, surfaceHeights[i]), color);
+            mesh[2 * i + 1] = sf::Vertex(sf::Vector2f(x, bottom), color);
+        }
+    }
+
+    void updateWaterLevel(std::vector<Ball>& balls) {
+        for (auto& ball : balls) {
+            if (ball.position.y + ball.radius >= bottom / SCALE) {
+                ball.position.y = bottom / SCALE - ball.radius;
+                ball.velocity.y = 0;
+                ball.atEquilibrium = true;
+            }
+        }
+
+        float totalWaterVolume = initialWaterVolume + displacedVolume;
+        float waterRise = ((totalWaterVolume - lastTotalVolume) / (poolWidth / SCALE)) * SCALE;
+
+        if (std::abs(totalWaterVolume - lastTotalVolume) > 0.0001f) {
+            top -= waterRise;
+
+            for (auto& height : surfaceHeights) {
+                height -= waterRise;
+            }
+
+            lastTotalVolume = totalWaterVolume;
+        }
+    }
+    void createWave(int index, float radius, float force) {
+        if (index >= 0 && index < static_cast<int>(surfaceHeights.size())) {
+            float spreadFactor = std::max(5.0f, std::min(radius * 10.0f, 50.0f));
+            float impactDepth = std::min(force * 0.02f, 5.0f);
+            surfaceHeights[index] += impactDepth;
+            velocities[index] -= force * 0.2f;
+
+            for (int i = -static_cast<int>(spreadFactor); i <= static_cast<int>(spreadFactor); i++) {
+                int waveIndex = index + i;
+                if (waveIndex >= 0 && waveIndex < static_cast<int>(surfaceHeights.size())) {
+                    float waveFactor = std::exp(-std::abs(i) / spreadFactor);
+                    velocities[waveIndex] -= force * waveFactor;
+                }
+            }
+        }
+    }
+
+    // Longest stable wave step for surface waves travelling at speed pixels
+    // per second.
+    float maxStableStep(float speed) const {
+        return waveCourant * dx / speed;
+    }
+
+    void update(float dt, float speed, WaveSolver solver, std::vector<Ball>& balls) {
+        PROFILE_ZONE("Water/Waves");
+        updateWaterLevel(balls);
+        // The stencil works in columns, so the speed is turned into a
+        // stiffness per column width squared.
+        float stiffness = (speed / dx) * (speed / dx);
+        if (solver == WaveSolver::Implicit) {
+            solveImplicit(dt, stiffness);
+            return;
+        }
+
+        // Per-step damping is rescaled so a different step length loses the
+        // same energy per second.
+        float stepRatio = dt / waveReferenceStep;
+        float damping = std::pow(waveDamping, stepRatio);
+        float energyLossFactor = std::min(1.0f, 0.2f * stepRatio);
+        propagateWaves(dt, damping, stiffness);
+        dampOpposingWaves(energyLossFactor);
+    }
+
+    // Wave stencil. Every column reads only the old heights and its own
+    // velocity, so the loop carries no dependency and vectorizes. The end
+    // columns are held in place.
+    void propagateWaves(float dt, float damping, float stiffness) {
+        const size_t n = surfaceHeights.size();
+        const float* heights = surfaceHeights.data();
+        float* next = nextHeights.data();
+        float* v = velocities.data();
+
+        next[0] = heights[0];
+        next[n - 1] = heights[n - 1];
+        for (size_t i = 1; i < n - 1; i++) {
+            float waveAcceleration = (heights[i - 1] + heights[i + 1] - 2 * heights[i]) * stiffness;
+            v[i] = (v[i] + waveAcceleration * dt) * damping;
+            next[i] = heights[i] + v[i] * dt;
+        }
+        surfaceHeights.swap(nextHeights);
+    }
+
+    // Backward Euler step. The new velocities solve
+    // (1 - a D) v' = v + dt * stiffness * D h, where D is the second
+    // difference across columns and a = dt^2 * stiffness, and the heights
+    // move by dt v'. Solving for velocities rather than heights keeps the
+    // rounding relative to the waves instead of the water depth, which
+    // matters because a grows huge at fine resolutions. The system is
+    // tridiagonal and solved by the Thomas algorithm in two sweeps. The
+    // scheme damps the shortest waves by itself, so neither waveDamping nor
+    // the opposing-wave loss is applied. The end columns are held in place.
+    void solveImplicit(float dt, float stiffness) {
+        const size_t n = surfaceHeights.size();
+        const float a = dt * dt * stiffness;
+        if (a != implicitCoupling) {
+            factorImplicit(a);
+        }
+
+        const float* heights = surfaceHeights.data();
+        const float* v = velocities.data();
+        const float* upper = implicitUpper.data();
+        const float* inversePivot = implicitInversePivot.data();
+        float* nextV = nextVelocities.data();
+        float* next = nextHeights.data();
+
+        const float acceleration = dt * stiffness;
+        nextV[0] = 0.0f;
+        for (size_t i = 1; i < n - 1; i++) {
+            float rhs = v[i] + (heights[i - 1] + heights[i + 1] - 2 * heights[i]) * acceleration;
+            nextV[i] = (rhs + a * nextV[i - 1]) * inversePivot[i];
+        }
+        nextV[n - 1] = 0.0f;
+        for (size_t i = n - 2; i > 0; i--) {
+            nextV[i] -= upper[i] * nextV[i + 1];
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            next[i] = heights[i] + nextV[i] * dt;
+        }
+        surfaceHeights.swap(nextHeights);
+        velocities.swap(nextVelocities);
+    }
+
+    // Forward elimination factors of the implicit system. They depend only
+    // on the coupling a, not on the heights.
+    void factorImplicit(float a) {
+        const size_t n = surfaceHeights.size();
+        implicitCoupling = a;
+        implicitUpper[0] = 0.0f;
+        implicitInversePivot[0] = 1.0f;
+        for (size_t i = 1; i < n - 1; i++) {
+            implicitInversePivot[i] = 1.0f / (1.0f + 2.0f * a + a * implicitUpper[i - 1]);
+            implicitUpper[i] = -a * implicitInversePivot[i];
+        }
+        implicitUpper[n - 1] = 0.0f;
+        implicitInversePivot[n - 1] = 1.0f;
+    }
+
+    // A column moving against a neighbour that moves the other way loses a
+    // share of the slower neighbour's speed. All columns read the velocities
+    // left by the stencil and the conditions become 0/1 factors, so this
+    // pass is branch free and vectorizes too.
+    void dampOpposingWaves(float energyLossFactor) {
+        const size_t n = velocities.size();
+        const float* v = velocities.data();
+        float* next = nextVelocities.data();
+
+        next[0] = v[0];
+        next[n - 1] = v[n - 1];
+        for (size_t i = 1; i < n - 1; i++) {
+            float againstLeft = static_cast<float>((v[i] > 0.0f) & (v[i - 1] < 0.0f));
+            float againstRight = static_cast<float>((v[i] < 0.0f) & (v[i + 1] > 0.0f));
+            float opposingWaveStrength = std::min(std::abs(v[i - 1]), std::abs(v[i + 1]));
+            next[i] = v[i] - opposingWaveStrength * energyLossFactor * (againstLeft - againstRight);
+        }
+        velocities.swap(nextVelocities);
+    }
+
+    // Water force on a ball for one ball step. Works out the ball's contact
+    // with the surface into contact and updates its in-water state. The
+    // water itself is left alone, so balls can be stepped in parallel; the
+    // ball step applies the waves and the level change for all of them.
+    sf::Vector2f interact(Ball& ball, BallContact& contact) const {
+        contact = BallContact();
+        sf::Vector2f force(0, 0);
+        int index = static_cast<int>((ball.position.x * SCALE - left) / dx);
+
+        if (index < 0 || index >= static_cast<int>(surfaceHeights.size()))
+            return force;
+        contact.column = index;
+
+        float ballBottom = (ball.position.y + ball.radius) * SCALE;
+        if (surfaceHeights[index] > ballBottom) {
+            ball.inWater = false;
+            ball.atEquilibrium = false;
+            ball.wasInWater = false;
+            return force;
+        }
+
+        float h = std::max(0.0f, std::min(ballBottom - surfaceHeights[index], 2 * ball.radius * SCALE));
+        contact.capHeight = h;
+        contact.submergedVolume = (M_PI * h * h * (3 * ball.radius * SCALE - h)) / (3.0f * SCALE * SCALE * SCALE);
+
+        if (!ball.inWater && surfaceHeights[index] < ballBottom) {
+            float impactForce = calculateImpactForce(ball);
+            force.y -= impactForce * 0.9f;
+            contact.waveImpulse = 0.1f * impactForce;
+
+            ball.velocity.y *= 0.4f;
+            ball.inWater = true;
+            ball.wasInWater = true;
+
+            return force;
+        }
+
+        ball.wasInWater = true;
+        ball.inWater = true;
+
+        float speed = std::abs(ball.velocity.y);
+        // exp(-h / r) is the square of the buoyancy exponential.
+        float shallowness = std::exp(-h / (ball.radius * 2));
+        float buoyancyFactor = 1 - shallowness;
+        float velocityDamping = std::min(1.0f, 0.8f + 0.2f * std::exp(-speed / 2.0f));
+        contact.buoyancy = waterDensity * g * contact.submergedVolume * buoyancyFactor * velocityDamping;
+
+        const float waterViscosity = 6 * M_PI * 0.001002f;
+        float dragForce = waterViscosity * ball.radius * ball.velocity.y;
+
+        float submergedArea = M_PI * ball.radius * ball.radius;
+        float reynolds = std::max(1.0f, (waterDensity * speed * (2 * ball.radius)) / (0.001002f));
+        float Cd = (reynolds < 2000) ? (24.0f / reynolds) : (0.47f + 0.5f / sqrt(reynolds));
+        Cd = std::max(0.1f, std::min(Cd, 1.2f));
+
+        float effectiveSubmergedArea = submergedArea * (contact.submergedVolume / ball.volume);
+        float turbulentDrag = 0.5f * Cd * waterDensity * effectiveSubmergedArea * ball.velocity.y * speed;
+
+        if (reynolds > 10'000) {
+            turbulentDrag *= 0.6f;
+        }
+
+        float vortexResistance = -0.2f * waterDensity * effectiveSubmergedArea * ball.velocity.y;
+        if (speed < 0.2f) {
+            vortexResistance *= 0.5f;
+        }
+
+        float depthFactor = 1.0f + (h / (2 * ball.radius));
+        float viscousDamping = waterDensity * contact.submergedVolume * g / (10.0f * depthFactor);
+        float viscousForce = -viscousDamping * ball.velocity.y;
+
+        float surfaceDampingFactor = 2.0f * (1 - shallowness * shallowness);
+        float surfaceForce = -surfaceDampingFactor * ball.velocity.y;
+
+        float airResistanceFactor = std::max(0.0f, 1.0f - (h / (2 * ball.radius)));
+        float airResistance = -airDensity * submergedArea * ball.velocity.y * ball.velocity.y * airResistanceFactor;
+
+        if (ball.velocity.y < -10.0f) {
+            ball.velocity.y *= 0.7f;
+        }
+
+        contact.drag = -dragForce - turbulentDrag * 0.9f + viscousForce + surfaceForce + airResistance + vortexResistance;
+        force.y = contact.drag - contact.buoyancy;
+
+        if (std::abs(force.y) < equilibriumThreshold && std::abs(ball.velocity.y) < 0.001f) {
+            ball.velocity.y = 0;
+            ball.atEquilibrium = true;
+        }
+        else {
+            ball.atEquilibrium = false;
+        }
+
+        return force;
+    }
+
+    float calculateImpactForce(const Ball& ball) const {
+        float impactTime = 0.02f;
+        float deltaV = std::abs(ball.velocity.y);
+        float impulseForce = (ball.mass * deltaV) / impactTime;
+
+        return impulseForce;
+    }
+
+    // Writes the surface interpolated by alpha into the mesh.
+    const std::vector<sf::Vertex>& buildMesh(float alpha) const {
+        sf::Vertex* surface = mesh.data();
+        for (size_t i = 0; i < surfaceHeights.size(); i++) {
+            surface[2 * i].position.y = previousHeights[i] + (surfaceHeights[i] - previousHeights[i]) * alpha;
+        }
+        return mesh;
+    }
+
+    void draw(sf::RenderWindow& window, float alpha) const {
+        PROFILE_ZONE("Water/Draw");
+        const std::vector<sf::Vertex>& vertices = buildMesh(alpha);
+        if (sf::VertexBuffer::isAvailable()) {
+            if (!meshBuffer) {
+                meshBuffer.reset(new sf::VertexBuffer(sf::TriangleStrip, sf::VertexBuffer::Stream));
+            }
+            if (meshBuffer->getVertexCount() != vertices.size()) {
+                meshBuffer->create(vertices.size());
+            }
+            if (meshBuffer->update(vertices.data())) {
+                window.draw(*meshBuffer);
+                return;
+            }
+        }
+        window.draw(vertices.data(), vertices.size(), sf::TriangleStrip);
+    }
+};
+
+// All balls as one list of triangles, drawn with a single call. Each ball is
+// a fan of a unit circle scaled and offset on the CPU; smaller balls on
+// screen use a circle with fewer segments.
+class BallMesh {
+    // Rim points of every level's unit circle, the first one repeated at the
+    // end so a fan never wraps.
+    std::vector<sf::Vector2f> rims;
+    std::vector<int> rimStart;
+    std::vector<int> segments;
+    // Largest on-screen radius in pixels each level stays within half a
+    // pixel of the true circle for.
+    std::vector<float> maxRadius;
+    std::vector<sf::Vertex> vertices;
+    sf::Color color;
+
+    int levelFor(float pixels) const {
+        int level = 0;
+        while (level + 1 < static_cast<int>(segments.size()) && pixels > maxRadius[level]) {
+            level++;
+        }
+        return level;
+    }
+
+public:
+    explicit BallMesh(sf::Color color = sf::Color::Red) : color(color) {
+        const int levels[] = { 6, 8, 12, 16, 24, 32, 48, 64, 96 };
+        for (int n : levels) {
+            rimStart.push_back(static_cast<int>(rims.size()));
+            segments.push_back(n);
+            maxRadius.push_back(static_cast<float>(0.5 / (1.0 - std::cos(M_PI / n))));
+            for (int k = 0; k <= n; k++) {
+                double angle = 2.0 * M_PI * (k % n) / n;
+                rims.emplace_back(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+            }
+        }
+    }
+
+    // Writes every ball, interpolated by alpha and scaled to pixels, into
+    // the vertex list. The list only grows, so a steady ball count does not
+    // allocate.
+    const std::vector<sf::Vertex>& build(const std::vector<Ball>& balls, float alpha, float scale) {
+        size_t count = 0;
+        for (const auto& ball : balls) {
+            count += 3 * segments[levelFor(ball.radius * scale)];
+        }
+        vertices.resize(count);
+
+        sf::Vertex* out = vertices.data();
+        for (const auto& ball : balls) {
+            const float radius = ball.radius * scale;
+            const int level = levelFor(radius);
+            const sf::Vector2f* rim = rims.data() + rimStart[level];
+            const sf::Vector2f center = (ball.previousPosition + (ball.position - ball.previousPosition) * alpha) * scale;
+            // Fields are written directly; sf::Vertex's constructors live in
+            // the SFML library and would be a call per vertex.
+            for (int k = 0; k < segments[level]; k++) {
+                out[0].position = center;
+                out[1].position = center + rim[k] * radius;
+                out[2].position = center + rim[k + 1] * radius;
+                out[0].color = out[1].color = out[2].color = color;
+                out += 3;
+            }
+        }
+        return vertices;
+    }
+
+    void draw(sf::RenderWindow& window, const std::vector<Ball>& balls, float alpha, float scale) {
+        PROFILE_ZONE("Water/Balls");
+        const std::vector<sf::Vertex>& triangles = build(balls, alpha, scale);
+        if (!triangles.empty()) {
+            window.draw(triangles.data(), triangles.size(), sf::Triangles);
+        }
+    }
+};
+
+// Tunables of the water simulation. WaterSim reads its own copy; the UI
+// edits a pending one that is handed over between updates.
+struct WaterParams {
+    // Radius and mass of newly added balls.
+    float radius = 0.40f;
+    float mass = 1.2f;
+    // Balls added per click, laid out in a square block.
+    int spawnCount = 1;
+    // Surface columns across the pool. Changing it starts a calm pool.
+    int resolution = 400;
+    // Longest ball substep in simulated seconds. The waves pick their own
+    // substeps from waveSpeed and the column width.
+    float dt1 = 0.01f;
+    // Speed of surface waves in pixels per second. 123.75 at 400 columns is
+    // the stiffness of 5000.5 per column the water was tuned with.
+    float waveSpeed = 123.75f;
+    WaveSolver solver = WaveSolver::Explicit;
+    // Threads the balls are stepped on. Any count gives the same result.
+    unsigned threads = WorkerPool::hardwareThreads();
+    // Simulated seconds per real second. At 0.6 a 60 Hz step is exactly one
+    // 0.01 s substep, which is what the water was tuned with.
+    float timeScale = 0.6f;
+};
+
+// Water and balls without any window or UI, so they can be stepped headless.
+class WaterSim {
+    Water water;
+    std::vector<Ball> balls;
+    BallCollisions collisions;
+    // Scratch of the ball step, one record per ball.
+    std::vector<BallContact> contacts;
+    // Per chunk of balls: the displaced volume and the balls that hit the
+    // surface, in ball order. Chunks are fixed runs of balls, so what each
+    // holds does not depend on which thread stepped it.
+    struct BallChunk {
+        float displacedVolume = 0.0f;
+        std::vector<uint32_t> impacts;
+    };
+    static const size_t kBallChunk = 1024;
+    std::vector<BallChunk> chunks;
+    WaterParams params;
+    int ballSteps = 0;
+    int waveSteps = 0;
+    bool wavesCapped = false;
+    WorkerPool pool{ WaterParams().threads };
+
+    static Water makePool(int resolution) {
+        return Water(50.0f, 250.0f, 700.0f, 300.0f, resolution);
+    }
+
+public:
+    WaterSim() : water(makePool(WaterParams().resolution)) {}
+
+    const WaterParams& getParams() const { return params; }
+    void setParams(const WaterParams& newParams) {
+        if (newParams.resolution != params.resolution) {
+            water = makePool(newParams.resolution);
+        }
+        params = newParams;
+        pool.setThreadCount(params.threads);
+        params.threads = pool.getThreadCount();
+    }
+
+    // Adds a ball with the current radius and mass; x and y are in metres.
+    void addBall(float x, float y) {
+        balls.emplace_back(x, y, params.radius, params.mass);
+    }
+
+    // Adds spawnCount balls in a square block centred on x, y, spaced so
+    // they do not touch.
+    void addBalls(float x, float y) {
+        int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(params.spawnCount))));
+        float spacing = 2.1f * params.radius;
+        float origin = -0.5f * spacing * (side - 1);
+        for (int i = 0; i < params.spawnCount; i++) {
+            addBall(x + origin + spacing * (i % side), y + origin + spacing * (i / side));
+        }
+    }
+
+    const Water& getWater() const { return water; }
+    const std::vector<Ball>& getBalls() const { return balls; }
+
+    // Substeps of the last update(). wavesCapped is set when the waves
+    // needed more than maxWaveSubsteps and ran past the stable step.
+    int getBallSteps() const { return ballSteps; }
+    int getWaveSteps() const { return waveSteps; }
+    bool getWavesCapped() const { return wavesCapped; }
+
+    void update(float dt) {
+        PROFILE_ZONE("Water/Update");
+        for (auto& ball : balls) {
+            ball.previousPosition = ball.position;
+        }
+        water.previousHeights = water.surfaceHeights;
+
+        // Balls and waves each split the frame into equal substeps of their
+        // own: balls by dt1, waves by the CFL limit, so a coarse surface does
+        // not take more steps than it needs and a fine one stays stable. The
+        // implicit solver is stable at any step and takes one.
+        float simTime = dt * params.timeScale;
+        ballSteps = std::max(1, static_cast<int>(std::ceil(simTime / params.dt1 - 0.0001f)));
+        int stableWaveSteps = params.solver == WaveSolver::Implicit ? 1 :
+            std::max(1, static_cast<int>(std::ceil(simTime / water.maxStableStep(params.waveSpeed) - 0.0001f)));
+        waveSteps = std::min(stableWaveSteps, maxWaveSubsteps);
+        wavesCapped = stableWaveSteps > maxWaveSubsteps;
+        float ballStep = simTime / ballSteps;
+        float waveStep = simTime / waveSteps;
+
+        // The two schedules are merged in time order; a ball step runs first
+        // when both end together.
+        int ball = 0;
+        int wave = 0;
+        while (ball < ballSteps || wave < waveSteps) {
+            bool ballFirst = wave == waveSteps ||
+                (ball < ballSteps && (ball + 1) * waveSteps <= (wave + 1) * ballSteps);
+            if (ballFirst) {
+                stepBalls(ballStep);
+                ball++;
+            }
+            else {
+                water.update(waveStep, params.waveSpeed, params.solver, balls);
+                wave++;
+            }
+        }
+    }
+
+private:
+    // Forces and integration run in parallel over chunks of balls; the
+    // water is only read meanwhile. The waves of balls that hit the surface
+    // and the displaced volume are then applied in chunk order, which is
+    // ball order, so the result matches a single thread bit for bit.
+    void stepBalls(float step) {
+        const size_t chunkCount = (balls.size() + kBallChunk - 1) / kBallChunk;
+        contacts.resize(balls.size());
+        if (chunks.size() < chunkCount) {
+            // Room for a whole chunk of impacts, so a step never allocates
+            // once its chunks exist.
+            chunks.resize(chunkCount);
+            for (auto& chunk : chunks) {
+                chunk.impacts.reserve(kBallChunk);
+            }
+        }
+        {
+            PROFILE_ZONE("Water/Forces");
+            auto job = [this, step](size_t chunk, unsigned) {
+                stepChunk(chunk, step);
+            };
+            pool.run(chunkCount, job);
+        }
+        applyContacts(chunkCount);
+        collisions.resolve(balls);
+    }
+
+    void stepChunk(size_t chunk, float step) {
+        BallChunk& out = chunks[chunk];
+        out.displacedVolume = 0.0f;
+        out.impacts.clear();
+        const size_t end = std::min(balls.size(), (chunk + 1) * kBallChunk);
+        for (size_t i = chunk * kBallChunk; i < end; i++) {
+            Ball& ball = balls[i];
+            BallContact& contact = contacts[i];
+            sf::Vector2f gravityAndAir = ball.getGravityAndAirResistance(step);
+            sf::Vector2f waterForces = water.interact(ball, contact);
+            sf::Vector2f totalForce = gravityAndAir + waterForces;
+            ball.applyForce(totalForce, step);
+            ball.update(step);
+
+            out.displacedVolume += contact.submergedVolume;
+            if (contact.waveImpulse > 0.0f) {
+                out.impacts.push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+
+    void applyContacts(size_t chunkCount) {
+        PROFILE_ZONE("Water/Contacts");
+        float volume = 0.0f;
+        for (size_t c = 0; c < chunkCount; c++) {
+            for (uint32_t i : chunks[c].impacts) {
+                water.createWave(contacts[i].column, balls[i].radius, contacts[i].waveImpulse);
+            }
+            volume += chunks[c].displacedVolume;
+        }
+        water.displacedVolume = volume;
+    }
+};
@@ -0,0 +1,132 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+
+WorkerPool::WorkerPool(unsigned threadCount)
+{
+    startWorkers(threadCount);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stopWorkers();
+}
+
+void WorkerPool::setThreadCount(unsigned threadCount)
+{
+    threadCount = std::max(1u, threadCount);
+    if (threadCount == getThreadCount())
+        return;
+
+    stopWorkers();
+    startWorkers(threadCount);
+}
+
+unsigned WorkerPool::hardwareThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void WorkerPool::startWorkers(unsigned threadCount)
+{
+    threadCount = std::max(1u, threadCount);
+    m_threadTimes.assign(threadCount, 0.0);
+
+    // New workers start at the current generation, so they wait for the
+    // next dispatch instead of taking the one before they existed for it.
+    unsigned long long generation;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+        generation = m_generation;
+    }
+
+    for (unsigned t = 1; t < threadCount; t++)
+        m_workers.emplace_back(&WorkerPool::workerLoop, this, t, generation);
+}
+
+void WorkerPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+}
+
+void WorkerPool::dispatch(std::size_t chunkCount, JobFn fn, void* context)
+{
+    std::fill(m_threadTimes.begin(), m_threadTimes.end(), 0.0);
+
+    if (m_workers.empty() || chunkCount <= 1)
+    {
+        m_fn = fn;
+        m_context = context;
+        m_chunkCount = chunkCount;
+        m_nextChunk.store(0, std::memory_order_relaxed);
+        work(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn = fn;
+        m_context = context;
+        m_chunkCount = chunkCount;
+        m_nextChunk.store(0, std::memory_order_relaxed);
+        m_busyWorkers = static_cast<unsigned>(m_workers.size());
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+}
+
+void WorkerPool::work(unsigned thread)
+{
+    PROFILE_ZONE("Pool/Work");
+    auto start = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        std::size_t chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= m_chunkCount)
+            break;
+        m_fn(m_context, chunk, thread);
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    m_threadTimes[thread] = std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+void WorkerPool::workerLoop(unsigned thread, unsigned long long seen)
+{
+    Profiler::setThreadName("Worker");
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seen; });
+            if (m_stopping)
+                return;
+            seen = m_generation;
+        }
+
+        work(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busyWorkers--;
+        }
+        m_done.notify_one();
+    }
+}
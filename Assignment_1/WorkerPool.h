@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that process numbered chunks of work. The
+// calling thread takes part as thread 0, so a pool of one thread runs
+// everything inline. Which thread picks up a chunk is not deterministic;
+// jobs must only depend on the chunk index to give reproducible results.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned threadCount = 1);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void setThreadCount(unsigned threadCount);
+    unsigned getThreadCount() const { return static_cast<unsigned>(m_threadTimes.size()); }
+
+    // Calls job(chunk, thread) for every chunk in [0, chunkCount) and returns
+    // once all of them have finished.
+    template <typename Job>
+    void run(std::size_t chunkCount, Job& job)
+    {
+        dispatch(chunkCount, &invoke<Job>, &job);
+    }
+
+    // Milliseconds each thread spent inside jobs during the last run().
+    const std::vector<double>& getThreadTimes() const { return m_threadTimes; }
+
+    static unsigned hardwareThreads();
+
+private:
+    typedef void (*JobFn)(void* context, std::size_t chunk, unsigned thread);
+
+    template <typename Job>
+    static void invoke(void* context, std::size_t chunk, unsigned thread)
+    {
+        (*static_cast<Job*>(context))(chunk, thread);
+    }
+
+    void dispatch(std::size_t chunkCount, JobFn fn, void* context);
+    void work(unsigned thread);
+    void workerLoop(unsigned thread, unsigned long long seen);
+    void startWorkers(unsigned threadCount);
+    void stopWorkers();
+
+    std::vector<std::thread> m_workers;
+    std::vector<double> m_threadTimes;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    unsigned long long m_generation = 0;
+    unsigned m_busyWorkers = 0;
+    bool m_stopping = false;
+
+    JobFn m_fn = nullptr;
+    void* m_context = nullptr;
+    std::size_t m_chunkCount = 0;
+    std::atomic<std::size_t> m_nextChunk{ 0 };
+};
@@ -1,15 +1,27 @@
 ﻿#include <SFML/Graphics.hpp>
+#include <cstring>
 #include <memory>
 #include "SceneInterface.h"
 #include "FireScene.h"
 #include "WaterScene.h"
 #include "LightScene.h"
+#include "Profiler.h"
+#include "ProfilerUI.h"
 #include <imgui-SFML.h>
 
 enum class SceneType { Fire, Water, Light };
 
-int main() {
-    
+int main(int argc, char** argv) {
+    Profiler::setThreadName("Main");
+    ProfilerUI profilerUI;
+
+    // --trace <file> records a trace from startup until exit.
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--trace") == 0)
+            profilerUI.startTrace(argv[i + 1]);
+    }
+
     sf::RenderWindow window(sf::VideoMode(1280, 720), "Combined Simulation");
     ImGui::SFML::Init(window);
     window.setFramerateLimit(60);
@@ -17,58 +29,115 @@ int main() {
     SceneType currentType = SceneType::Fire;
     std::unique_ptr<SceneInterface> currentScene = std::make_unique<FireScene>();
 
+    // Scenes are simulated at a fixed rate and drawn interpolated between
+    // the last two steps, so the display rate can differ from it.
+    FixedStep scheduler(60.0f, 5);
+    float simulationRate = scheduler.getRate();
+    int frameLimit = 60;
+    bool interpolate = true;
+
     sf::Clock deltaClock;
     sf::Clock clock;
 
     while (window.isOpen()) {
         ImGui::SFML::Update(window, deltaClock.restart());
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            ImGui::SFML::ProcessEvent(window, event);
-            if (event.type == sf::Event::Closed)
-                window.close();
+        {
+            PROFILE_ZONE("Events");
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                ImGui::SFML::ProcessEvent(window, event);
+                if (event.type == sf::Event::Closed)
+                    window.close();
 
-            if (event.type == sf::Event::MouseButtonPressed)
-            {
-                if (ImGui::GetIO().WantCaptureMouse)
+                if (event.type == sf::Event::MouseButtonPressed)
                 {
-                    continue;
-                }
-            }
-            if (event.type == sf::Event::KeyPressed) {
-                if (event.key.code == sf::Keyboard::Num1) {
-                    currentScene = std::make_unique<FireScene>();
-                    currentType = SceneType::Fire;
+                    if (ImGui::GetIO().WantCaptureMouse)
+                    {
+                        continue;
+                    }
                 }
-                else if (event.key.code == sf::Keyboard::Num2) {
-                    currentScene = std::make_unique<WaterScene>();
-                    currentType = SceneType::Water;
-                }
-                else if (event.key.code == sf::Keyboard::Num3) {
-                    currentScene = std::make_unique<LightScene>();
-                    currentType = SceneType::Light;
+                if (event.type == sf::Event::KeyPressed) {
+                    if (event.key.code == sf::Keyboard::Num1) {
+                        currentScene = std::make_unique<FireScene>();
+                        currentType = SceneType::Fire;
+                    }
+                    else if (event.key.code == sf::Keyboard::Num2) {
+                        currentScene = std::make_unique<WaterScene>();
+                        currentType = SceneType::Water;
+                    }
+                    else if (event.key.code == sf::Keyboard::Num3) {
+                        currentScene = std::make_unique<LightScene>();
+                        currentType = SceneType::Light;
+                    }
+                    else if (event.key.code == sf::Keyboard::F2) {
+                        profilerUI.saveCsv();
+                    }
+                    else if (event.key.code == sf::Keyboard::F3) {
+                        profilerUI.toggleTrace();
+                    }
                 }
+
+                currentScene->handleEvent(event, window);
             }
+        }
 
-            currentScene->handleEvent(event, window);
+        {
+            PROFILE_ZONE("GUI");
+            ImGui::Begin("Simulation");
+            if (ImGui::SliderFloat("Rate (Hz)", &simulationRate, 10.0f, 240.0f, "%.0f"))
+            {
+                scheduler.setRate(simulationRate);
+            }
+            if (ImGui::SliderInt("Frame Limit", &frameLimit, 0, 240))
+            {
+                window.setFramerateLimit(frameLimit);
+            }
+            ImGui::Checkbox("Interpolate", &interpolate);
+            ImGui::Text("Steps this frame: %d", scheduler.getLastSteps());
+            ImGui::End();
+
+            profilerUI.draw();
+            currentScene->renderGUI();
+            currentScene->applyParams();
         }
 
         float dt = clock.restart().asSeconds();
-        currentScene->update(dt);
+        int steps = scheduler.advance(dt);
+        {
+            PROFILE_ZONE("Update");
+            for (int i = 0; i < steps; i++)
+            {
+                currentScene->update(scheduler.getStep());
+            }
+        }
+
+        {
+            PROFILE_ZONE("Render");
+            if (currentType == SceneType::Light)
+            {
+                window.clear(sf::Color::White);
+            }
+            else
+            {
+                window.clear(sf::Color::Black);
+            }
+            currentScene->render(window, interpolate ? scheduler.getAlpha() : 1.0f);
+        }
 
-        if (currentType == SceneType::Light)
         {
-            window.clear(sf::Color::White);
+            PROFILE_ZONE("ImGui Render");
+            ImGui::SFML::Render(window);
         }
-        else
+
         {
-            window.clear(sf::Color::Black);
+            // Includes the wait for the frame limit.
+            PROFILE_ZONE("Display");
+            window.display();
         }
-        currentScene->render(window);
-        ImGui::SFML::Render(window);
-        window.display();
+        Profiler::endFrame();
     }
 
+    profilerUI.stopTrace();
     ImGui::SFML::Shutdown();
     return 0;
 }
\ No newline at end of file